@@ -6,7 +6,13 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "filesys/page_cache.h"
+#endif
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -32,6 +38,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +54,52 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* PCI configuration space, accessed through configuration
+   mechanism #1. */
+#define PCI_CONFIG_ADDR 0xcf8           /* Address of the config dword. */
+#define PCI_CONFIG_DATA 0xcfc           /* The config dword itself. */
+#define PCI_REG_ID 0x00                 /* Device ID:Vendor ID. */
+#define PCI_REG_COMMAND 0x04            /* Status:Command. */
+#define PCI_REG_CLASS 0x08              /* Class:Subclass:Prog IF:Rev. */
+#define PCI_REG_BAR4 0x20               /* Base address register 4. */
+#define PCI_CMD_IO 0x0001               /* Decode I/O space accesses. */
+#define PCI_CMD_MASTER 0x0004           /* Allow bus mastering. */
+
+/* Bus master IDE port addresses, one block of 8 ports per channel
+   starting at the controller's BAR4. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start the transfer. */
+#define BM_CMD_READ 0x08        /* Direction: 1=disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Transfer failed (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Device interrupted (write 1 to clear). */
+
+/* A physical region descriptor.  A channel's PRD table lists the
+   physical memory that a DMA transfer moves, one region per
+   entry.  A region may not cross a 64 kB boundary, so we never let
+   one cross a page. */
+struct prd {
+	uint32_t addr;              /* Physical address, must be even. */
+	uint16_t size;              /* Byte count, 0 means 64 kB. */
+	uint16_t flags;             /* PRD_EOT on the table's last entry. */
+};
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
+/* -nodma: Move all data with PIO, even if the controller can do
+   bus master DMA. */
+bool disk_dma_disabled;
 
 /* An ATA device. */
 struct disk {
@@ -56,9 +109,15 @@ struct disk {
 
 	bool is_ata;                /* 1=This device is an ATA disk. */
 	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+	int multiple;               /* Sectors per interrupt for READ/WRITE
+								   MULTIPLE, or 0 if unsupported. */
+	bool dma;                   /* Transfer with bus master DMA? */
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
+	long long cmd_cnt;          /* Number of read and write commands. */
+	long long dma_cnt;          /* Number of those done by DMA. */
+	long long merge_cnt;        /* Number of bios merged into another. */
 };
 
 /* An ATA channel (aka controller).
@@ -68,11 +127,21 @@ struct channel {
 	uint16_t reg_base;          /* Base I/O port. */
 	uint8_t irq;                /* Interrupt in use. */
 
-	struct lock lock;           /* Must acquire to access the controller. */
+	/* Requests wait in QUEUE, sorted by disk and sector, until the
+	   channel's I/O thread, the only thread that touches the
+	   controller after disk_init(), takes them in C-LOOK order. */
+	struct lock lock;           /* Protects QUEUE and HEAD_POS. */
+	struct condition queue_cond;        /* Signaled on a new request. */
+	struct list queue;          /* Queued requests, by bio_key(). */
+	uint64_t head_pos;          /* bio_key() just past the last request. */
+
 	bool expecting_interrupt;   /* True if an interrupt is expected, false if
 								   any interrupt would be spurious. */
 	struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+	uint16_t bm_base;           /* Bus master base I/O port, 0 if none. */
+	struct prd *prdt;           /* PRD table, one page. */
+
 	struct disk devices[2];     /* The devices on this channel. */
 };
 
@@ -80,12 +149,17 @@ struct channel {
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
+static void channel_io_thread (void *);
+static void pio_read (struct bio *);
+static void pio_write (struct bio *);
+static bool dma_transfer (struct bio *);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
@@ -99,6 +173,7 @@ static void interrupt_handler (struct intr_frame *);
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
+	uint16_t bm_base = disk_dma_disabled ? 0 : find_bus_master ();
 	size_t chan_no;
 
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -120,9 +195,22 @@ disk_init (void) {
 				NOT_REACHED ();
 		}
 		lock_init (&c->lock);
+		cond_init (&c->queue_cond);
+		list_init (&c->queue);
+		c->head_pos = 0;
 		c->expecting_interrupt = false;
 		sema_init (&c->completion_wait, 0);
 
+		/* Each channel has its own block of bus master registers
+		   and its own PRD table. */
+		c->bm_base = 0;
+		c->prdt = NULL;
+		if (bm_base != 0) {
+			c->prdt = palloc_get_page (0);
+			if (c->prdt != NULL && vtop (c->prdt) < (1ULL << 32))
+				c->bm_base = bm_base + chan_no * 8;
+		}
+
 		/* Initialize devices. */
 		for (dev_no = 0; dev_no < 2; dev_no++) {
 			struct disk *d = &c->devices[dev_no];
@@ -132,8 +220,11 @@ disk_init (void) {
 
 			d->is_ata = false;
 			d->capacity = 0;
+			d->multiple = 0;
+			d->dma = false;
 
-			d->read_cnt = d->write_cnt = 0;
+			d->read_cnt = d->write_cnt = d->cmd_cnt = d->dma_cnt = 0;
+			d->merge_cnt = 0;
 		}
 
 		/* Register interrupt handler. */
@@ -150,6 +241,11 @@ disk_init (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++)
 			if (c->devices[dev_no].is_ata)
 				identify_ata_device (&c->devices[dev_no]);
+
+		/* From now on only this thread talks to the channel.  A channel
+		   without a disk gets no requests, so it gets no thread either. */
+		if (c->devices[0].is_ata || c->devices[1].is_ata)
+			thread_create (c->name, PRI_MAX, channel_io_thread, c);
 	}
 
 	/* DO NOT MODIFY BELOW LINES. */
@@ -167,10 +263,15 @@ disk_print_stats (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++) {
 			struct disk *d = disk_get (chan_no, dev_no);
 			if (d != NULL && d->is_ata)
-				printf ("%s: %lld reads, %lld writes\n",
-						d->name, d->read_cnt, d->write_cnt);
+				printf ("%s: %lld reads, %lld writes, %lld commands "
+						"(%lld DMA, %lld merged)\n",
+						d->name, d->read_cnt, d->write_cnt, d->cmd_cnt,
+						d->dma_cnt, d->merge_cnt);
 		}
 	}
+#ifdef FILESYS
+	page_cache_print_stats ();
+#endif
 }
 
 /* Returns the disk numbered DEV_NO--either 0 or 1 for master or
@@ -209,21 +310,7 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
-	struct channel *c;
-
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
-
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
+	disk_read_multiple (d, sec_no, buffer, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -233,27 +320,251 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
    per-disk locking is unneeded. */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+	disk_write_multiple (d, sec_no, buffer, 1);
+}
+
+static void disk_rw_sync (struct disk *, disk_sector_t, void *, size_t cnt,
+		bool write);
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Submits the sectors as bios of up to DISK_MAX_SECTORS
+   each and waits for them to complete. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, void *buffer,
+		size_t cnt) {
+	disk_rw_sync (d, sec_no, buffer, cnt, false);
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+		const void *buffer, size_t cnt) {
+	disk_rw_sync (d, sec_no, (void *) buffer, cnt, true);
+}
+
+/* Block requests. */
+
+/* Sort key of bio B in its channel's queue: the two disks on a
+   channel are swept one after the other. */
+static uint64_t
+bio_key (const struct bio *b) {
+	return ((uint64_t) b->disk->dev_no << 32) | b->sector;
+}
+
+static bool
+bio_less (const struct list_elem *a_, const struct list_elem *b_,
+		void *aux UNUSED) {
+	return bio_key (list_entry (a_, struct bio, elem))
+		< bio_key (list_entry (b_, struct bio, elem));
+}
+
+/* Queues B for transfer and returns at once.  B->end_io is called
+   from the I/O thread of B's channel when the transfer is done;
+   until then the caller must leave B and its buffer alone.
+
+   A bio that continues or precedes a queued request for the same
+   disk and direction is merged into it, so that both go to the
+   disk as one command. */
+void
+disk_submit (struct bio *b) {
 	struct channel *c;
+	struct list_elem *e;
 
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+	ASSERT (b != NULL && b->disk != NULL && b->buffer != NULL);
+	ASSERT (b->cnt > 0 && b->cnt <= DISK_MAX_SECTORS);
+	ASSERT (b->sector + b->cnt <= b->disk->capacity);
+	ASSERT (!intr_context ());
+
+	c = b->disk->channel;
+	b->next = NULL;
+	b->req_cnt = b->cnt;
 
-	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e)) {
+		struct bio *r = list_entry (e, struct bio, elem);
+
+		if (r->disk != b->disk || r->write != b->write
+				|| r->req_cnt + b->cnt > DISK_MAX_SECTORS)
+			continue;
+		if (r->sector + r->req_cnt == b->sector) {
+			/* B goes at the end of R's chain. */
+			struct bio *tail = r;
+
+			while (tail->next != NULL)
+				tail = tail->next;
+			tail->next = b;
+			r->req_cnt += b->cnt;
+			b->disk->merge_cnt++;
+			lock_release (&c->lock);
+			return;
+		}
+		if (b->sector + b->cnt == r->sector) {
+			/* B takes R's place at the head of the chain. */
+			b->next = r;
+			b->req_cnt += r->req_cnt;
+			list_remove (&r->elem);
+			b->disk->merge_cnt++;
+			break;
+		}
+	}
+	list_insert_ordered (&c->queue, &b->elem, bio_less, NULL);
+	cond_signal (&c->queue_cond, &c->lock);
 	lock_release (&c->lock);
 }
-
+
+/* Completion callback for disk_rw_sync(). */
+static void
+bio_end_sync (struct bio *b) {
+	sema_up (b->private);
+}
+
+/* Moves CNT sectors between disk D starting at SEC_NO and BUFFER,
+   to the disk if WRITE is true, and waits until they are done. */
+static void
+disk_rw_sync (struct disk *d, disk_sector_t sec_no, void *buffer_,
+		size_t cnt, bool write) {
+	uint8_t *buffer = buffer_;
+
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+
+	while (cnt > 0) {
+		struct semaphore done;
+		struct bio b;
+
+		sema_init (&done, 0);
+		b.disk = d;
+		b.sector = sec_no;
+		b.cnt = cnt < DISK_MAX_SECTORS ? cnt : DISK_MAX_SECTORS;
+		b.buffer = buffer;
+		b.write = write;
+		b.end_io = bio_end_sync;
+		b.private = &done;
+		disk_submit (&b);
+		sema_down (&done);
+
+		sec_no += b.cnt;
+		buffer += b.cnt * DISK_SECTOR_SIZE;
+		cnt -= b.cnt;
+	}
+}
+
+/* Takes the next request off channel C's queue: C-LOOK, that is,
+   the first one at or past the head position, or the lowest one
+   once the head has passed them all.  C's lock must be held. */
+static struct bio *
+channel_next_request (struct channel *c) {
+	struct list_elem *e;
+
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e))
+		if (bio_key (list_entry (e, struct bio, elem)) >= c->head_pos)
+			break;
+	if (e == list_end (&c->queue))
+		e = list_begin (&c->queue);
+	list_remove (e);
+	return list_entry (e, struct bio, elem);
+}
+
+/* I/O thread of channel C.  Carries out queued requests one
+   command each, by DMA when possible and by PIO otherwise, then
+   completes every bio in the request. */
+static void
+channel_io_thread (void *c_) {
+	struct channel *c = c_;
+
+	for (;;) {
+		struct disk *d;
+		struct bio *r, *next;
+
+		lock_acquire (&c->lock);
+		while (list_empty (&c->queue))
+			cond_wait (&c->queue_cond, &c->lock);
+		r = channel_next_request (c);
+		c->head_pos = bio_key (r) + r->req_cnt;
+		lock_release (&c->lock);
+
+		d = r->disk;
+		if (!d->dma || !dma_transfer (r)) {
+			if (r->write)
+				pio_write (r);
+			else
+				pio_read (r);
+		}
+		if (r->write)
+			d->write_cnt += r->req_cnt;
+		else
+			d->read_cnt += r->req_cnt;
+		d->cmd_cnt++;
+
+		/* END_IO may free its bio. */
+		for (; r != NULL; r = next) {
+			next = r->next;
+			r->end_io (r);
+		}
+	}
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
 
+/* Reads the configuration dword at REG of PCI function
+   BUS:DEV.FUNC. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg) {
+	outl (PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11)
+			| (func << 8) | (reg & 0xfc));
+	return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the configuration dword at REG of PCI function
+   BUS:DEV.FUNC. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value) {
+	outl (PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11)
+			| (func << 8) | (reg & 0xfc));
+	outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a
+   bus master, such as the PIIX3/4 that QEMU emulates.  If one is
+   found, enables its bus mastering and returns the base I/O port
+   of its bus master registers.  Otherwise returns 0. */
+static uint16_t
+find_bus_master (void) {
+	int dev, func;
+
+	for (dev = 0; dev < 32; dev++)
+		for (func = 0; func < 8; func++) {
+			uint32_t class, bar4;
+
+			if ((pci_read_config (0, dev, func, PCI_REG_ID) & 0xffff) == 0xffff)
+				continue;
+
+			/* Mass storage (0x01), IDE (0x01), bus master capable
+			   (bit 7 of the programming interface). */
+			class = pci_read_config (0, dev, func, PCI_REG_CLASS);
+			if ((class >> 16) != 0x0101 || !(class & 0x8000))
+				continue;
+
+			/* BAR4 must point into I/O space. */
+			bar4 = pci_read_config (0, dev, func, PCI_REG_BAR4);
+			if (!(bar4 & 1) || (bar4 & 0xfffc) == 0)
+				continue;
+
+			pci_write_config (0, dev, func, PCI_REG_COMMAND,
+					pci_read_config (0, dev, func, PCI_REG_COMMAND)
+					| PCI_CMD_IO | PCI_CMD_MASTER);
+			return bar4 & 0xfffc;
+		}
+	return 0;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -364,6 +675,23 @@ identify_ata_device (struct disk *d) {
 	/* Calculate capacity. */
 	d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+	/* Word 47 gives the most sectors the disk can move per
+	   interrupt with READ/WRITE MULTIPLE, 0 if it cannot.  Ask for
+	   that many with SET MULTIPLE MODE. */
+	if ((id[47] & 0xff) != 0) {
+		select_device_wait (d);
+		outb (reg_nsect (c), id[47] & 0xff);
+		issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+		sema_down (&c->completion_wait);
+		wait_while_busy (d);
+		if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+			d->multiple = id[47] & 0xff;
+	}
+
+	/* Word 49 bit 8 says the disk can do DMA.  Use it if the
+	   channel found a bus master controller. */
+	d->dma = c->bm_base != 0 && (id[49] & (1 << 8)) != 0;
+
 	/* Print identification message. */
 	printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
 	if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -379,7 +707,12 @@ identify_ata_device (struct disk *d) {
 	print_ata_string ((char *) &id[27], 40);
 	printf ("\", serial \"");
 	print_ata_string ((char *) &id[10], 20);
-	printf ("\"\n");
+	printf ("\"");
+	if (d->dma)
+		printf (", DMA");
+	else if (d->multiple > 0)
+		printf (", %d sectors per interrupt", d->multiple);
+	printf ("\n");
 }
 
 /* Prints STRING, which consists of SIZE bytes in a funky format:
@@ -402,17 +735,18 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= DISK_MAX_SECTORS);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == DISK_MAX_SECTORS ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -432,6 +766,143 @@ issue_pio_command (struct channel *c, uint8_t command) {
 	outb (reg_command (c), command);
 }
 
+/* Returns the buffer for sector I of request R, counting across
+   the bios merged into it. */
+static uint8_t *
+bio_sector_buffer (struct bio *r, size_t i) {
+	while (i >= r->cnt) {
+		i -= r->cnt;
+		r = r->next;
+	}
+	return (uint8_t *) r->buffer + i * DISK_SECTOR_SIZE;
+}
+
+/* Reads request R from its disk by PIO. */
+static void
+pio_read (struct bio *r) {
+	struct disk *d = r->disk;
+	struct channel *c = d->channel;
+	size_t block = d->multiple > 0 ? (size_t) d->multiple : 1;
+	size_t done;
+
+	select_sector (d, r->sector, r->req_cnt);
+	issue_pio_command (c, d->multiple > 0
+			? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+	for (done = 0; done < r->req_cnt; done += block) {
+		size_t i;
+
+		if (block > r->req_cnt - done)
+			block = r->req_cnt - done;
+		sema_down (&c->completion_wait);
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+					r->sector + (disk_sector_t) done);
+		for (i = 0; i < block; i++)
+			input_sector (c, bio_sector_buffer (r, done + i));
+	}
+}
+
+/* Writes request R to its disk by PIO. */
+static void
+pio_write (struct bio *r) {
+	struct disk *d = r->disk;
+	struct channel *c = d->channel;
+	size_t block = d->multiple > 0 ? (size_t) d->multiple : 1;
+	size_t done;
+
+	select_sector (d, r->sector, r->req_cnt);
+	issue_pio_command (c, d->multiple > 0
+			? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+	for (done = 0; done < r->req_cnt; done += block) {
+		size_t i;
+
+		if (block > r->req_cnt - done)
+			block = r->req_cnt - done;
+		/* The first block is sent as soon as the disk asks for it;
+		   each later block follows the interrupt that acknowledges
+		   the one before. */
+		if (done > 0)
+			sema_down (&c->completion_wait);
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+					r->sector + (disk_sector_t) done);
+		for (i = 0; i < block; i++)
+			output_sector (c, bio_sector_buffer (r, done + i));
+	}
+	sema_down (&c->completion_wait);
+}
+
+/* Fills channel C's PRD table to describe the buffers of request
+   R, one entry per page touched by each bio.  Returns false if a
+   buffer is not in the kernel's direct map below 4 GB, or is odd,
+   so that the controller cannot reach it, or if the table is too
+   small. */
+static bool
+build_prdt (struct channel *c, struct bio *r) {
+	size_t i = 0;
+
+	for (; r != NULL; r = r->next) {
+		const uint8_t *p = r->buffer;
+		size_t size = r->cnt * DISK_SECTOR_SIZE;
+
+		if (!is_kernel_vaddr (p) || ((uintptr_t) p & 1) != 0
+				|| vtop (p + size - 1) >= (1ULL << 32))
+			return false;
+
+		while (size > 0) {
+			size_t page_left = PGSIZE - pg_ofs (p);
+			size_t chunk = size < page_left ? size : page_left;
+
+			if (i >= PRD_CNT)
+				return false;
+			c->prdt[i].addr = vtop (p);
+			c->prdt[i].size = chunk;
+			c->prdt[i].flags = 0;
+			p += chunk;
+			size -= chunk;
+			i++;
+		}
+	}
+	c->prdt[i - 1].flags = PRD_EOT;
+	return true;
+}
+
+/* Carries out request R by bus master DMA.  The CPU is free while
+   the controller moves the data and the I/O thread sleeps until
+   the completion interrupt.  Returns false, without touching the
+   disk, if the controller cannot reach R's buffers. */
+static bool
+dma_transfer (struct bio *r) {
+	struct disk *d = r->disk;
+	struct channel *c = d->channel;
+	uint8_t status;
+
+	if (!build_prdt (c, r))
+		return false;
+
+	/* Load the PRD table, clear the old status and set the
+	   direction before the disk gets the command. */
+	outb (reg_bm_command (c), 0);
+	outl (reg_bm_prdt (c), vtop (c->prdt));
+	outb (reg_bm_status (c),
+			inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+	outb (reg_bm_command (c), r->write ? 0 : BM_CMD_READ);
+
+	select_sector (d, r->sector, r->req_cnt);
+	issue_pio_command (c, r->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb (reg_bm_command (c), (r->write ? 0 : BM_CMD_READ) | BM_CMD_START);
+	sema_down (&c->completion_wait);
+
+	status = inb (reg_bm_status (c));
+	outb (reg_bm_command (c), 0);
+	outb (reg_bm_status (c), status | BM_STA_ERR | BM_STA_INTR);
+	if ((status & BM_STA_ERR) || (inb (reg_alt_status (c)) & STA_ERR))
+		PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu, d->name,
+				r->write ? "write" : "read", r->sector);
+	d->dma_cnt++;
+	return true;
+}
+
 /* Reads a sector from channel C's data register in PIO mode into
    SECTOR, which must have room for DISK_SECTOR_SIZE bytes. */
 static void
@@ -1,8 +1,11 @@
 #include "filesys/fat.h"
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#include <bitmap.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -22,14 +25,28 @@ struct fat_fs {
 	unsigned int *fat;
 	unsigned int fat_length;
 	disk_sector_t data_start;
-	cluster_t last_clst;
-	struct lock write_lock;
+	cluster_t last_clst;           /* Next-fit hint: where to search next. */
+	struct lock write_lock;        /* Serializes changes to the FAT. */
+	struct bitmap *used_map;       /* One bit per cluster, set if in use
+	                                  (or not loaded yet). */
+	size_t free_cnt;               /* Number of known free clusters. */
+	size_t fat_sector_cnt;         /* Number of FAT sectors in use. */
+	struct bitmap *loaded_map;     /* FAT sectors read from the disk. */
+	struct bitmap *dirty_map;      /* FAT sectors changed since the last
+	                                  fat_sync(). */
+	struct list chains;            /* Live chain caches, struct fat_chain. */
+	struct bitmap *cached_map;     /* Clusters held by a built chain
+	                                  cache. */
 };
 
+/* FAT entries per FAT sector. */
+#define FAT_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (cluster_t))
+
 static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_maps_init (bool loaded);
 
 void
 fat_init (void) {
@@ -53,31 +70,13 @@ fat_init (void) {
 
 void
 fat_open (void) {
+	// The table is read one sector at a time on first access, so
+	// mounting costs nothing but the allocation.
+	free (fat_fs->fat);
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT load failed");
-
-	// Load FAT directly from the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_read = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
-	}
+	fat_maps_init (false);
 }
 
 void
@@ -90,27 +89,45 @@ fat_close (void) {
 	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
+	// Write back the FAT sectors that changed
+	fat_sync ();
+}
+
+/* Writes every dirty FAT sector back to the disk, adjacent sectors in a
+ * single command.  A partial last sector goes through a bounce
+ * buffer. */
+void
+fat_sync (void) {
+	const size_t last = fat_fs->fat_length / FAT_PER_SECTOR;
+	size_t start = 0, end, next;
+
+	lock_acquire (&fat_fs->write_lock);
+	while ((start = bitmap_scan (fat_fs->dirty_map, start, 1, true))
+			!= BITMAP_ERROR) {
+		for (end = start + 1; end < fat_fs->fat_sector_cnt
+				&& bitmap_test (fat_fs->dirty_map, end); end++)
+			continue;
+		bitmap_set_multiple (fat_fs->dirty_map, start, end - start, false);
+		next = end;
+
+		if (end > last) {
+			// The last sector is only partly covered by the table.
+			uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
 			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
+				PANIC ("FAT sync failed");
+			memcpy (bounce, fat_fs->fat + last * FAT_PER_SECTOR,
+					(fat_fs->fat_length - last * FAT_PER_SECTOR)
+					* sizeof (cluster_t));
+			disk_write (filesys_disk, fat_fs->bs.fat_start + last, bounce);
 			free (bounce);
+			end = last;
 		}
+		if (end > start)
+			disk_write_multiple (filesys_disk, fat_fs->bs.fat_start + start,
+					fat_fs->fat + start * FAT_PER_SECTOR, end - start);
+		start = next;
 	}
+	lock_release (&fat_fs->write_lock);
 }
 
 void
@@ -120,10 +137,15 @@ fat_create (void) {
 	fat_fs_init ();
 
 	// Create FAT table
+	free (fat_fs->fat);
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT creation failed");
 
+	// The fresh table is all in memory and must all be written out.
+	fat_maps_init (true);
+	bitmap_set_all (fat_fs->dirty_map, true);
+
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
 
@@ -131,7 +153,8 @@ fat_create (void) {
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
 	if (buf == NULL)
 		PANIC ("FAT create failed due to OOM");
-	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
+	page_cache_write (cluster_to_sector (ROOT_DIR_CLUSTER), buf, 0,
+			DISK_SECTOR_SIZE);
 	free (buf);
 }
 
@@ -152,42 +175,472 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	// Clusters are numbered from 1; entry 0 of the FAT is never used, so
+	// that 0 can mean "no cluster".
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER + 1;
+	fat_fs->fat_sector_cnt = DIV_ROUND_UP (fat_fs->fat_length, FAT_PER_SECTOR);
+	fat_fs->last_clst = ROOT_DIR_CLUSTER + 1;
+	lock_init (&fat_fs->write_lock);
+	list_init (&fat_fs->chains);
+}
+
+/* Sets up the cluster and FAT sector maps.  If LOADED, the whole table
+ * is taken to be in memory already and every cluster but 0 is free;
+ * otherwise nothing is loaded, and until a sector is loaded its clusters
+ * count as used, so that allocation never hands them out. */
+static void
+fat_maps_init (bool loaded) {
+	if (fat_fs->used_map == NULL)
+		fat_fs->used_map = bitmap_create (fat_fs->fat_length);
+	if (fat_fs->loaded_map == NULL)
+		fat_fs->loaded_map = bitmap_create (fat_fs->fat_sector_cnt);
+	if (fat_fs->dirty_map == NULL)
+		fat_fs->dirty_map = bitmap_create (fat_fs->fat_sector_cnt);
+	if (fat_fs->cached_map == NULL)
+		fat_fs->cached_map = bitmap_create (fat_fs->fat_length);
+	if (fat_fs->used_map == NULL || fat_fs->loaded_map == NULL
+			|| fat_fs->dirty_map == NULL || fat_fs->cached_map == NULL)
+		PANIC ("FAT bitmap creation failed");
+
+	bitmap_set_all (fat_fs->used_map, !loaded);
+	bitmap_mark (fat_fs->used_map, 0);
+	bitmap_set_all (fat_fs->loaded_map, loaded);
+	bitmap_set_all (fat_fs->dirty_map, false);
+	fat_fs->free_cnt = loaded ? fat_fs->fat_length - 1 : 0;
+}
+
+/* Reads FAT sector IDX from the disk, if that has not happened yet, and
+ * records which of its clusters are free.  The caller must hold
+ * write_lock. */
+static void
+fat_load_sector (size_t idx) {
+	cluster_t first = idx * FAT_PER_SECTOR;
+	cluster_t end = first + FAT_PER_SECTOR;
+	cluster_t clst;
+
+	ASSERT (lock_held_by_current_thread (&fat_fs->write_lock));
+
+	if (bitmap_test (fat_fs->loaded_map, idx))
+		return;
+
+	if (end <= fat_fs->fat_length)
+		disk_read (filesys_disk, fat_fs->bs.fat_start + idx,
+				fat_fs->fat + first);
+	else {
+		uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
+		if (bounce == NULL)
+			PANIC ("FAT load failed");
+		disk_read (filesys_disk, fat_fs->bs.fat_start + idx, bounce);
+		end = fat_fs->fat_length;
+		memcpy (fat_fs->fat + first, bounce, (end - first) * sizeof (cluster_t));
+		free (bounce);
+	}
+
+	for (clst = first > 0 ? first : 1; clst < end; clst++)
+		if (fat_fs->fat[clst] == 0) {
+			bitmap_reset (fat_fs->used_map, clst);
+			fat_fs->free_cnt++;
+		}
+	bitmap_mark (fat_fs->loaded_map, idx);
+}
+
+/* Makes sure the FAT entry for CLST is in memory. */
+static void
+fat_ensure_loaded (cluster_t clst) {
+	size_t idx = clst / FAT_PER_SECTOR;
+	bool held;
+
+	if (bitmap_test (fat_fs->loaded_map, idx))
+		return;
+
+	held = lock_held_by_current_thread (&fat_fs->write_lock);
+	if (!held)
+		lock_acquire (&fat_fs->write_lock);
+	fat_load_sector (idx);
+	if (!held)
+		lock_release (&fat_fs->write_lock);
+}
+
+/* Loads the first FAT sector not yet in memory, searching from the one
+ * that holds the next-fit hint and wrapping around.  Returns false if
+ * the whole table is loaded.  The caller must hold write_lock. */
+static bool
+fat_load_more (void) {
+	size_t idx = bitmap_scan (fat_fs->loaded_map,
+			fat_fs->last_clst / FAT_PER_SECTOR, 1, false);
+
+	if (idx == BITMAP_ERROR)
+		idx = bitmap_scan (fat_fs->loaded_map, 0, 1, false);
+	if (idx == BITMAP_ERROR)
+		return false;
+	fat_load_sector (idx);
+	return true;
+}
+
+/* Sets the FAT entry for CLST to VAL, keeping the cluster map and the
+ * dirty sector map up to date.  The caller must hold write_lock. */
+static void
+fat_set (cluster_t clst, cluster_t val) {
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+
+	fat_ensure_loaded (clst);
+	if ((fat_fs->fat[clst] != 0) != (val != 0)) {
+		bitmap_set (fat_fs->used_map, clst, val != 0);
+		if (val != 0)
+			fat_fs->free_cnt--;
+		else
+			fat_fs->free_cnt++;
+	}
+	fat_fs->fat[clst] = val;
+	bitmap_mark (fat_fs->dirty_map, clst / FAT_PER_SECTOR);
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Finds up to CNT free clusters in a row, searching from HINT onward
+ * and then wrapping around (next fit), and marks them used.  Takes the
+ * first run of CNT if there is one among the loaded FAT sectors,
+ * otherwise a single cluster, and loads more sectors only when the
+ * loaded ones are full.  Stores the number taken in *TAKEN and returns
+ * the first, or 0 if the disk is full.  The caller must hold
+ * write_lock. */
+static cluster_t
+fat_alloc_run (cluster_t hint, size_t cnt, size_t *taken) {
+	struct bitmap *map = fat_fs->used_map;
+	size_t clst;
+
+	if (hint == 0 || hint >= fat_fs->fat_length)
+		hint = 1;
+	fat_ensure_loaded (hint);
+
+	for (;;) {
+		if (cnt > 1) {
+			clst = bitmap_scan_and_flip (map, hint, cnt, false);
+			if (clst == BITMAP_ERROR)
+				clst = bitmap_scan_and_flip (map, 1, cnt, false);
+			if (clst != BITMAP_ERROR) {
+				*taken = cnt;
+				break;
+			}
+		}
+
+		clst = bitmap_scan_and_flip (map, hint, 1, false);
+		if (clst == BITMAP_ERROR)
+			clst = bitmap_scan_and_flip (map, 1, 1, false);
+		if (clst != BITMAP_ERROR) {
+			*taken = 1;
+			break;
+		}
+		if (!fat_load_more ())
+			return 0;
+	}
+
+	fat_fs->free_cnt -= *taken;
+	fat_fs->last_clst = clst + *taken;
+	return clst;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Chain caches                                                               */
+/*----------------------------------------------------------------------------*/
+
+/* Appends CLST to the runs of CH, extending the last run if CLST follows
+ * it on disk, and notes in cached_map that a cache holds it.  Returns
+ * false if out of memory. */
+static bool
+chain_push (struct fat_chain *ch, cluster_t clst) {
+	struct fat_run *last = ch->run_cnt > 0 ? &ch->runs[ch->run_cnt - 1] : NULL;
+
+	if (last != NULL && last->clst + last->len == clst) {
+		last->len++;
+		bitmap_mark (fat_fs->cached_map, clst);
+		return true;
+	}
+	if (ch->run_cnt == ch->run_cap) {
+		size_t cap = ch->run_cap > 0 ? ch->run_cap * 2 : 8;
+		struct fat_run *runs = realloc (ch->runs, cap * sizeof *runs);
+
+		if (runs == NULL)
+			return false;
+		ch->runs = runs;
+		ch->run_cap = cap;
+		last = ch->run_cnt > 0 ? &ch->runs[ch->run_cnt - 1] : NULL;
+	}
+	ch->runs[ch->run_cnt++] = (struct fat_run) {
+		.pos = last != NULL ? last->pos + last->len : 0,
+		.clst = clst,
+		.len = 1,
+	};
+	bitmap_mark (fat_fs->cached_map, clst);
+	return true;
+}
+
+/* Forgets the runs of CH, so that it is rebuilt on next use.  The
+ * caller must hold write_lock. */
+static void
+chain_drop (struct fat_chain *ch) {
+	size_t i;
+
+	for (i = 0; i < ch->run_cnt; i++)
+		bitmap_set_multiple (fat_fs->cached_map, ch->runs[i].clst,
+				ch->runs[i].len, false);
+	ch->run_cnt = 0;
+	ch->built = false;
+}
+
+/* Walks the chain of CH once and records it as runs.  Leaves CH unbuilt
+ * if out of memory.  The caller must hold write_lock. */
+static void
+chain_build (struct fat_chain *ch) {
+	cluster_t clst;
+
+	ch->run_cnt = 0;
+	ch->built = true;
+	for (clst = ch->start; clst != 0 && clst != EOChain; clst = fat_get (clst))
+		if (!chain_push (ch, clst)) {
+			chain_drop (ch);
+			return;
+		}
+}
+
+/* Returns true if built cache CH holds CLST. */
+static bool
+chain_contains (const struct fat_chain *ch, cluster_t clst) {
+	size_t i;
+
+	for (i = 0; i < ch->run_cnt; i++)
+		if (clst >= ch->runs[i].clst && clst < ch->runs[i].clst + ch->runs[i].len)
+			return true;
+	return false;
+}
+
+/* Returns the last cluster of built, non-empty cache CH. */
+static cluster_t
+chain_last (const struct fat_chain *ch) {
+	const struct fat_run *last = &ch->runs[ch->run_cnt - 1];
+
+	return last->clst + last->len - 1;
+}
+
+/* Returns the built cache that holds CLST, or a null pointer if there
+ * is none.  Only clusters marked in cached_map cost a search.  The
+ * caller must hold write_lock. */
+static struct fat_chain *
+chain_find (cluster_t clst) {
+	struct list_elem *e;
+
+	if (!bitmap_test (fat_fs->cached_map, clst))
+		return NULL;
+	for (e = list_begin (&fat_fs->chains); e != list_end (&fat_fs->chains);
+			e = list_next (e)) {
+		struct fat_chain *ch = list_entry (e, struct fat_chain, elem);
+
+		if (ch->built && chain_contains (ch, clst))
+			return ch;
+	}
+	return NULL;
+}
+
+/* Drops the cache whose chain holds CLST, if any, so that it is rebuilt
+ * on next use.  The caller must hold write_lock. */
+static void
+chain_invalidate (cluster_t clst) {
+	struct fat_chain *ch = chain_find (clst);
+
+	if (ch != NULL)
+		chain_drop (ch);
+}
+
+/* Records in the cache whose chain ended at TAIL, if any, that CLST now
+ * follows it.  The caller must hold write_lock. */
+static void
+chain_appended (cluster_t tail, cluster_t clst) {
+	struct fat_chain *ch = chain_find (tail);
+
+	if (ch != NULL && chain_last (ch) == tail && !chain_push (ch, clst))
+		chain_drop (ch);
+}
+
+/* Initializes CH as a cache of the chain starting at START, which may be
+ * 0 for no chain.  Nothing is read until the first fat_chain_get(). */
+void
+fat_chain_init (struct fat_chain *ch, cluster_t start) {
+	ch->start = start;
+	ch->runs = NULL;
+	ch->run_cnt = ch->run_cap = 0;
+	ch->built = false;
+	lock_acquire (&fat_fs->write_lock);
+	list_push_back (&fat_fs->chains, &ch->elem);
+	lock_release (&fat_fs->write_lock);
+}
+
+/* Frees the runs of CH and stops keeping it up to date. */
+void
+fat_chain_destroy (struct fat_chain *ch) {
+	lock_acquire (&fat_fs->write_lock);
+	chain_drop (ch);
+	list_remove (&ch->elem);
+	lock_release (&fat_fs->write_lock);
+	free (ch->runs);
+}
+
+/* Returns the cluster at position POS (counting from 0) of CH's chain,
+ * or 0 if the chain is shorter.  Builds the runs on first use; after
+ * that each call is a binary search over them. */
+cluster_t
+fat_chain_get (struct fat_chain *ch, size_t pos) {
+	cluster_t clst = 0;
+
+	lock_acquire (&fat_fs->write_lock);
+	if (!ch->built)
+		chain_build (ch);
+	if (ch->built) {
+		if (ch->run_cnt > 0) {
+			size_t lo = 0, hi = ch->run_cnt - 1;
+			const struct fat_run *r;
+
+			while (lo < hi) {
+				size_t mid = (lo + hi + 1) / 2;
+
+				if (ch->runs[mid].pos <= pos)
+					lo = mid;
+				else
+					hi = mid - 1;
+			}
+			r = &ch->runs[lo];
+			if (pos < r->pos + r->len)
+				clst = r->clst + (pos - r->pos);
+		}
+	} else {
+		/* Out of memory: walk the chain. */
+		for (clst = ch->start; clst != 0 && clst != EOChain && pos > 0; pos--)
+			clst = fat_get (clst);
+		if (clst == EOChain)
+			clst = 0;
+	}
+	lock_release (&fat_fs->write_lock);
+	return clst;
+}
+
+/* Returns the last cluster of the chain that CLST belongs to, taking it
+ * from a chain cache if one holds CLST.  The caller must hold
+ * write_lock. */
+static cluster_t
+fat_chain_tail (cluster_t clst) {
+	struct fat_chain *ch = chain_find (clst);
+	cluster_t next;
+
+	if (ch != NULL)
+		return chain_last (ch);
+	while ((next = fat_get (clst)) != EOChain)
+		clst = next;
+	return clst;
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	return fat_create_chain_multiple (clst, 1);
+}
+
+/* Add CNT clusters to the chain, trying to keep them contiguous on disk:
+ * right after the end of the chain if possible, and in as few runs as
+ * possible otherwise.
+ * If CLST is 0, start a new chain.
+ * Returns the first new cluster, or 0 (allocating nothing) if there are
+ * fewer than CNT free clusters. */
+cluster_t
+fat_create_chain_multiple (cluster_t clst, size_t cnt) {
+	cluster_t first = 0, tail, hint;
+
+	ASSERT (cnt > 0);
+
+	lock_acquire (&fat_fs->write_lock);
+	while (fat_fs->free_cnt < cnt)
+		if (!fat_load_more ()) {
+			lock_release (&fat_fs->write_lock);
+			return 0;
+		}
+
+	tail = clst != 0 ? fat_chain_tail (clst) : 0;
+	hint = tail != 0 ? tail + 1 : fat_fs->last_clst;
+	while (cnt > 0) {
+		size_t taken, i;
+		cluster_t run = fat_alloc_run (hint, cnt, &taken);
+
+		ASSERT (run != 0);
+		for (i = 0; i < taken; i++) {
+			// fat_set() would count the cluster as allocated again.
+			fat_fs->fat[run + i] = EOChain;
+			bitmap_mark (fat_fs->dirty_map, (run + i) / FAT_PER_SECTOR);
+			if (tail != 0) {
+				fat_set (tail, run + i);
+				chain_appended (tail, run + i);
+			}
+			tail = run + i;
+		}
+		if (first == 0)
+			first = run;
+		hint = tail + 1;
+		cnt -= taken;
+	}
+	lock_release (&fat_fs->write_lock);
+	return first;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	chain_invalidate (clst);
+	if (pclst != 0)
+		fat_set (pclst, EOChain);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_get (clst);
+
+		fat_set (clst, 0);
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	chain_invalidate (clst);
+	fat_set (clst, val);
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+
+	fat_ensure_loaded (clst);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Convert a sector number in the data region to its cluster #. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
 }
@@ -3,11 +3,16 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Bytes read ahead of a sequential reader. */
+#define READAHEAD_BYTES (16 * DISK_SECTOR_SIZE)
+
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+	off_t ra_pos;               /* 순차 읽기라면 다음 읽기가 시작할 위치 */
+	off_t ra_end;               /* readahead 를 요청해 둔 끝 위치 */
 };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -71,8 +76,23 @@ file_get_inode (struct file *file) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
+	bool sequential = file->pos == file->ra_pos;
 	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
 	file->pos += bytes_read;
+	file->ra_pos = file->pos;
+
+	/* 지난번 읽기가 끝난 곳부터 이어 읽으면 그 뒤 섹터를 미리 요청한다.
+	 * 이미 요청한 구간은 다시 요청하지 않는다. */
+	if (!sequential)
+		file->ra_end = file->pos;
+	else if (bytes_read > 0) {
+		off_t start = file->pos > file->ra_end ? file->pos : file->ra_end;
+		off_t end = file->pos + READAHEAD_BYTES;
+		if (start < end) {
+			inode_readahead (file->inode, start, end - start);
+			file->ra_end = end;
+		}
+	}
 	return bytes_read;
 }
 
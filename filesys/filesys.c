@@ -3,9 +3,11 @@
 #include <stdio.h>
 #include <string.h>
 #include "filesys/file.h"
+#include "filesys/fat.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/page_cache.h"
 #include "devices/disk.h"
 
 /* The disk that contains the file system. */
@@ -21,6 +23,7 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+	page_cache_init ();
 	inode_init ();
 
 #ifdef EFILESYS
@@ -50,6 +53,33 @@ filesys_done (void) {
 	fat_close ();
 #else
 	free_map_close ();
+#endif
+	page_cache_flush ();
+}
+
+/* Allocates a sector for a new inode and stores it into *SECTORP.
+ * Under EFILESYS the sector is a one-cluster chain of its own. */
+static bool
+inode_sector_allocate (disk_sector_t *sectorp) {
+#ifdef EFILESYS
+	cluster_t clst = fat_create_chain (0);
+
+	if (clst == 0)
+		return false;
+	*sectorp = cluster_to_sector (clst);
+	return true;
+#else
+	return free_map_allocate (1, sectorp);
+#endif
+}
+
+/* Releases a sector taken by inode_sector_allocate(). */
+static void
+inode_sector_release (disk_sector_t sector) {
+#ifdef EFILESYS
+	fat_remove_chain (sector_to_cluster (sector), 0);
+#else
+	free_map_release (sector, 1);
 #endif
 }
 
@@ -62,11 +92,11 @@ filesys_create (const char *name, off_t initial_size) {
 	disk_sector_t inode_sector = 0;
 	struct dir *dir = dir_open_root ();
 	bool success = (dir != NULL
-			&& free_map_allocate (1, &inode_sector)
+			&& inode_sector_allocate (&inode_sector)
 			&& inode_create (inode_sector, initial_size)
 			&& dir_add (dir, name, inode_sector));
 	if (!success && inode_sector != 0)
-		free_map_release (inode_sector, 1);
+		inode_sector_release (inode_sector);
 	dir_close (dir);
 
 	return success;
@@ -108,8 +138,11 @@ do_format (void) {
 	printf ("Formatting file system...");
 
 #ifdef EFILESYS
-	/* Create FAT and save it to the disk. */
+	/* Create FAT and save it to the disk.  The root directory's inode
+	 * takes ROOT_DIR_CLUSTER, which fat_create() has set aside. */
 	fat_create ();
+	if (!dir_create (cluster_to_sector (ROOT_DIR_CLUSTER), 16))
+		PANIC ("root directory creation failed");
 	fat_close ();
 #else
 	free_map_create ();
@@ -4,20 +4,82 @@
 #include <round.h>
 #include <string.h>
 #include "filesys/filesys.h"
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#else
 #include "filesys/free-map.h"
+#endif
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+#ifdef EFILESYS
+/* Bytes per cluster. */
+#define CLUSTER_SIZE (SECTORS_PER_CLUSTER * DISK_SECTOR_SIZE)
+
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * The data lives in the FAT chain starting at START, which holds just
+ * enough clusters for LENGTH bytes. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
+	cluster_t start;                    /* First data cluster, or 0. */
 	uint32_t unused[125];               /* Not used. */
 };
+#else
+/* A run of LENGTH consecutive data sectors starting at START. */
+struct extent {
+	disk_sector_t start;                /* First sector of the run. */
+	uint32_t length;                    /* Number of sectors. */
+};
+
+/* Extents held in the inode itself and in each overflow block. */
+#define INODE_EXTENTS 62
+#define OVERFLOW_EXTENTS 63
+
+/* A new extent takes at least 1/GROW_RESERVE of what the file already
+ * has, so that a file growing a block at a time next to another one
+ * still gets longer and longer runs, and its extent count grows only
+ * with the log of its size. */
+#define GROW_RESERVE 4
+
+/* On-disk inode.
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * The data sectors are listed as extents in file order; those past the
+ * first INODE_EXTENTS live in a chain of overflow blocks starting at
+ * OVERFLOW. */
+struct inode_disk {
+	off_t length;                       /* File size in bytes. */
+	unsigned magic;                     /* Magic number. */
+	uint32_t extent_cnt;                /* Number of extents. */
+	disk_sector_t overflow;             /* First overflow block, or 0. */
+	struct extent extents[INODE_EXTENTS];   /* First extents. */
+};
+
+/* On-disk overflow block: the next OVERFLOW_EXTENTS extents.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct overflow_block {
+	struct extent extents[OVERFLOW_EXTENTS];    /* Extents, in file order. */
+	disk_sector_t next;                 /* Next overflow block, or 0. */
+	uint32_t unused;                    /* Not used. */
+};
+
+/* The extents of an inode past its first INODE_EXTENTS, and the first
+ * file sector of every extent, for byte_to_sector().  A full table is
+ * replaced by a copy twice as big; the old one is kept until the inode
+ * is closed, so that byte_to_sector() can go on using it without a
+ * lock. */
+struct extent_table {
+	struct extent_table *old;           /* Table this one replaced. */
+	size_t cap;                         /* Room for this many extents. */
+	uint32_t *pos;                      /* First file sector of each. */
+	struct extent *more;                /* Extents INODE_EXTENTS onward. */
+};
+#endif
 
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
@@ -33,22 +95,404 @@ struct inode {
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	struct lock grow_lock;              /* Serializes file growth. */
 	struct inode_disk data;             /* Inode content. */
+#ifdef EFILESYS
+	struct fat_chain chain;             /* Runs of the data chain. */
+#else
+	struct extent_table *ext;           /* Extent positions and overflow. */
+	disk_sector_t *ovf;                 /* Overflow block sectors. */
+	size_t ovf_cnt;                     /* Number of overflow blocks. */
+	size_t ovf_dirty;                   /* First overflow block changed
+	                                       since the last write back. */
+#endif
 };
 
+#ifdef EFILESYS
+/* Returns the number of clusters to allocate for an inode SIZE
+ * bytes long. */
+static inline size_t
+bytes_to_clusters (off_t size) {
+	return DIV_ROUND_UP (size, CLUSTER_SIZE);
+}
+
+/* Returns the number of data sectors allocated to INODE.  The chain
+ * always holds just enough clusters for the length. */
+static size_t
+inode_allocated (struct inode *inode) {
+	return bytes_to_clusters (inode->data.length) * SECTORS_PER_CLUSTER;
+}
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
+	cluster_t clst;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if (pos >= inode->data.length)
 		return -1;
+
+	clst = fat_chain_get (&inode->chain, pos / CLUSTER_SIZE);
+	return cluster_to_sector (clst) + pos % CLUSTER_SIZE / DISK_SECTOR_SIZE;
+}
+
+/* Appends zeroed clusters to INODE's chain until it can hold LENGTH
+ * bytes, all of them in one fat_create_chain_multiple() call so that
+ * they are laid out in as few runs as possible.
+ * Returns false, allocating nothing, if the disk fills up. */
+static bool
+inode_grow (struct inode *inode, off_t length) {
+	static char zeros[DISK_SECTOR_SIZE];
+	size_t have = bytes_to_clusters (inode->data.length);
+	size_t need = bytes_to_clusters (length);
+	cluster_t clst;
+	size_t i;
+
+	if (have >= need)
+		return true;
+	clst = fat_create_chain_multiple (inode->data.start, need - have);
+	if (clst == 0)
+		return false;
+	if (inode->data.start == 0) {
+		inode->data.start = clst;
+		fat_chain_destroy (&inode->chain);
+		fat_chain_init (&inode->chain, clst);
+	}
+
+	for (; have < need; have++) {
+		clst = fat_chain_get (&inode->chain, have);
+		for (i = 0; i < SECTORS_PER_CLUSTER; i++)
+			page_cache_write (cluster_to_sector (clst) + i, zeros, 0,
+					DISK_SECTOR_SIZE);
+	}
+	return true;
+}
+
+/* Releases INODE's data clusters. */
+static void
+inode_release_data (struct inode *inode) {
+	if (inode->data.start != 0)
+		fat_remove_chain (inode->data.start, 0);
+}
+
+/* Releases the sector that holds an inode, which is a chain of its
+ * own. */
+static void
+inode_release_sector (disk_sector_t sector) {
+	fat_remove_chain (sector_to_cluster (sector), 0);
+}
+
+/* Reads INODE's on-disk inode from the buffer cache and sets up the
+ * cache of its data chain, which byte_to_sector() searches.
+ * Always succeeds. */
+static bool
+inode_read_back (struct inode *inode) {
+	page_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	fat_chain_init (&inode->chain, inode->data.start);
+	return true;
+}
+
+/* Stops caching INODE's data chain. */
+static void
+inode_forget_data (struct inode *inode) {
+	fat_chain_destroy (&inode->chain);
+}
+
+/* Writes INODE's on-disk inode to the buffer cache. */
+static void
+inode_write_back (struct inode *inode) {
+	page_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+}
+#else
+
+/* Returns extent I of INODE. */
+static struct extent *
+inode_extent (struct inode *inode, size_t i) {
+	ASSERT (i < inode->ext->cap);
+	return i < INODE_EXTENTS
+		? &inode->data.extents[i] : &inode->ext->more[i - INODE_EXTENTS];
+}
+
+/* Returns the number of data sectors allocated to INODE, which may be
+ * more than its length needs. */
+static size_t
+inode_allocated (struct inode *inode) {
+	size_t last = inode->data.extent_cnt;
+
+	if (last == 0)
+		return 0;
+	return inode->ext->pos[last - 1] + inode_extent (inode, last - 1)->length;
+}
+
+/* Returns the disk sector that contains byte offset POS within
+ * INODE.
+ * Returns -1 if INODE does not contain data for a byte at offset
+ * POS. */
+static disk_sector_t
+byte_to_sector (struct inode *inode, off_t pos) {
+	struct extent_table *t;
+	struct extent *e;
+	size_t lo, hi;
+	uint32_t sec;
+
+	ASSERT (inode != NULL);
+	if (pos >= inode->data.length)
+		return -1;
+
+	/* The table is read after the count, so it holds every extent
+	 * counted. */
+	hi = inode->data.extent_cnt - 1;
+	barrier ();
+	t = inode->ext;
+
+	/* Binary search for the last extent starting at or before SEC. */
+	sec = pos / DISK_SECTOR_SIZE;
+	lo = 0;
+	while (lo < hi) {
+		size_t mid = (lo + hi + 1) / 2;
+
+		if (t->pos[mid] <= sec)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	e = lo < INODE_EXTENTS
+		? &inode->data.extents[lo] : &t->more[lo - INODE_EXTENTS];
+	return e->start + (sec - t->pos[lo]);
+}
+
+/* Makes INODE's extent table hold at least CNT extents, replacing it by
+ * a bigger copy if needed.  Returns false if out of memory. */
+static bool
+extent_table_reserve (struct inode *inode, size_t cnt) {
+	struct extent_table *old = inode->ext, *t;
+	size_t cap = old != NULL ? old->cap : INODE_EXTENTS;
+
+	if (old != NULL && cnt <= old->cap)
+		return true;
+	while (cap < cnt)
+		cap *= 2;
+
+	t = malloc (sizeof *t + cap * sizeof *t->pos
+			+ (cap - INODE_EXTENTS) * sizeof *t->more);
+	if (t == NULL)
+		return false;
+	t->old = old;
+	t->cap = cap;
+	t->pos = (uint32_t *) (t + 1);
+	t->more = (struct extent *) (t->pos + cap);
+	if (old != NULL) {
+		memcpy (t->pos, old->pos, old->cap * sizeof *t->pos);
+		memcpy (t->more, old->more,
+				(old->cap - INODE_EXTENTS) * sizeof *t->more);
+	}
+	barrier ();
+	inode->ext = t;
+	return true;
 }
 
+/* Notes that extent I of INODE changed, so that inode_write_back()
+ * writes out the overflow block that holds it. */
+static void
+inode_extent_dirty (struct inode *inode, size_t i) {
+	size_t b;
+
+	if (i < INODE_EXTENTS)
+		return;
+	b = (i - INODE_EXTENTS) / OVERFLOW_EXTENTS;
+	if (b < inode->ovf_dirty)
+		inode->ovf_dirty = b;
+}
+
+/* Makes room for one more extent in INODE: in its extent table and,
+ * past the inode's own extents, in an overflow block, chaining a new
+ * one when the last is full.  Returns false if out of memory or
+ * disk. */
+static bool
+inode_extent_room (struct inode *inode) {
+	size_t cnt = inode->data.extent_cnt;
+	disk_sector_t *ovf;
+
+	if (!extent_table_reserve (inode, cnt + 1))
+		return false;
+	if (cnt < INODE_EXTENTS + inode->ovf_cnt * OVERFLOW_EXTENTS)
+		return true;
+
+	ovf = realloc (inode->ovf, (inode->ovf_cnt + 1) * sizeof *ovf);
+	if (ovf == NULL)
+		return false;
+	inode->ovf = ovf;
+	if (!free_map_allocate (1, &ovf[inode->ovf_cnt]))
+		return false;
+	if (inode->ovf_cnt == 0)
+		inode->data.overflow = ovf[0];
+	else if (inode->ovf_cnt - 1 < inode->ovf_dirty)
+		inode->ovf_dirty = inode->ovf_cnt - 1;  /* Its NEXT changes. */
+	inode->ovf_cnt++;
+	return true;
+}
+
+/* Allocates data sectors to INODE, zeroed, until it can hold LENGTH
+ * bytes, taking at least 1/GROW_RESERVE of its size more at a time.
+ * The last extent grows in place while the sectors after it are free;
+ * otherwise a new extent takes the longest free run that fits, halving
+ * the request until one does.
+ * Returns false if the disk or memory runs out first; the sectors
+ * allocated so far stay with INODE. */
+static bool
+inode_grow (struct inode *inode, off_t length) {
+	static char zeros[DISK_SECTOR_SIZE];
+	size_t have = inode_allocated (inode);
+	size_t need = bytes_to_sectors (length);
+
+	while (have < need) {
+		size_t want = need - have;
+		disk_sector_t start = 0;
+		size_t got = 0, i;
+
+		if (want < have / GROW_RESERVE)
+			want = have / GROW_RESERVE;
+		if (inode->data.extent_cnt > 0) {
+			struct extent *e;
+
+			i = inode->data.extent_cnt - 1;
+			e = inode_extent (inode, i);
+			start = e->start + e->length;
+			got = free_map_extend (start, want);
+			e->length += got;
+			inode_extent_dirty (inode, i);
+		}
+		if (got == 0) {
+			if (!inode_extent_room (inode))
+				return false;
+			for (got = want; got > 0; got /= 2)
+				if (free_map_allocate (got, &start))
+					break;
+			if (got == 0)
+				return false;
+
+			/* Fill the extent in before counting it, so that it is
+			 * never seen half made. */
+			i = inode->data.extent_cnt;
+			inode->ext->pos[i] = have;
+			inode_extent (inode, i)->start = start;
+			inode_extent (inode, i)->length = got;
+			inode_extent_dirty (inode, i);
+			barrier ();
+			inode->data.extent_cnt = i + 1;
+		}
+
+		for (i = 0; i < got; i++)
+			page_cache_write (start + i, zeros, 0, DISK_SECTOR_SIZE);
+		have += got;
+	}
+	return true;
+}
+
+/* Releases INODE's data sectors and overflow blocks. */
+static void
+inode_release_data (struct inode *inode) {
+	size_t i;
+
+	for (i = 0; i < inode->data.extent_cnt; i++) {
+		struct extent *e = inode_extent (inode, i);
+		free_map_release (e->start, e->length);
+	}
+	for (i = 0; i < inode->ovf_cnt; i++)
+		free_map_release (inode->ovf[i], 1);
+}
+
+/* Releases the sector that holds an inode. */
+static void
+inode_release_sector (disk_sector_t sector) {
+	free_map_release (sector, 1);
+}
+
+/* Returns the number of INODE's extents that overflow block B holds. */
+static size_t
+overflow_extent_cnt (struct inode *inode, size_t b) {
+	size_t first = INODE_EXTENTS + b * OVERFLOW_EXTENTS;
+	size_t cnt = inode->data.extent_cnt;
+
+	if (cnt <= first)
+		return 0;
+	return cnt - first < OVERFLOW_EXTENTS ? cnt - first : OVERFLOW_EXTENTS;
+}
+
+/* Reads INODE's on-disk inode, and its overflow blocks if any, from the
+ * buffer cache, and finds where each extent starts within the file for
+ * byte_to_sector().  Returns false if out of memory. */
+static bool
+inode_read_back (struct inode *inode) {
+	disk_sector_t next;
+	uint32_t pos;
+	size_t i;
+
+	inode->ext = NULL;
+	inode->ovf = NULL;
+	inode->ovf_cnt = 0;
+	page_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	if (!extent_table_reserve (inode, inode->data.extent_cnt))
+		return false;
+
+	for (next = inode->data.overflow; next != 0; ) {
+		disk_sector_t *ovf = realloc (inode->ovf,
+				(inode->ovf_cnt + 1) * sizeof *ovf);
+		size_t b = inode->ovf_cnt;
+
+		if (ovf == NULL)
+			return false;
+		inode->ovf = ovf;
+		ovf[inode->ovf_cnt++] = next;
+		page_cache_read (next, &inode->ext->more[b * OVERFLOW_EXTENTS], 0,
+				overflow_extent_cnt (inode, b) * sizeof (struct extent));
+		page_cache_read (next, &next, offsetof (struct overflow_block, next),
+				sizeof next);
+	}
+	inode->ovf_dirty = inode->ovf_cnt;
+
+	for (i = 0, pos = 0; i < inode->data.extent_cnt; i++) {
+		inode->ext->pos[i] = pos;
+		pos += inode_extent (inode, i)->length;
+	}
+	return true;
+}
+
+/* Frees INODE's extent tables, old ones included. */
+static void
+inode_forget_data (struct inode *inode) {
+	while (inode->ext != NULL) {
+		struct extent_table *old = inode->ext->old;
+
+		free (inode->ext);
+		inode->ext = old;
+	}
+	free (inode->ovf);
+	inode->ovf = NULL;
+}
+
+/* Writes INODE's on-disk inode, and the overflow blocks that changed,
+ * to the buffer cache. */
+static void
+inode_write_back (struct inode *inode) {
+	size_t b;
+
+	page_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	for (b = inode->ovf_dirty; b < inode->ovf_cnt; b++) {
+		disk_sector_t next = b + 1 < inode->ovf_cnt ? inode->ovf[b + 1] : 0;
+
+		page_cache_write (inode->ovf[b], &inode->ext->more[b * OVERFLOW_EXTENTS],
+				0, overflow_extent_cnt (inode, b) * sizeof (struct extent));
+		page_cache_write (inode->ovf[b], &next,
+				offsetof (struct overflow_block, next), sizeof next);
+	}
+	inode->ovf_dirty = inode->ovf_cnt;
+}
+#endif
+
 /* List of open inodes, so that opening a single inode twice
  * returns the same `struct inode'. */
 static struct list open_inodes;
@@ -66,32 +510,33 @@ inode_init (void) {
  * Returns false if memory or disk allocation fails. */
 bool
 inode_create (disk_sector_t sector, off_t length) {
-	struct inode_disk *disk_inode = NULL;
+	struct inode *inode = NULL;
 	bool success = false;
 
 	ASSERT (length >= 0);
 
 	/* If this assertion fails, the inode structure is not exactly
 	 * one sector in size, and you should fix that. */
-	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
-
-	disk_inode = calloc (1, sizeof *disk_inode);
-	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
-		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
+	ASSERT (sizeof inode->data == DISK_SECTOR_SIZE);
+
+	/* Build the inode in a scratch in-memory inode, so that
+	 * inode_grow() can lay out its data.  It starts out empty and
+	 * takes LENGTH once the data is there. */
+	inode = calloc (1, sizeof *inode);
+	if (inode != NULL) {
+		inode->sector = sector;
+		inode->data.magic = INODE_MAGIC;
+#ifdef EFILESYS
+		fat_chain_init (&inode->chain, 0);
+#endif
+		if (inode_grow (inode, length)) {
+			inode->data.length = length;
+			inode_write_back (inode);
 			success = true; 
-		} 
-		free (disk_inode);
+		} else
+			inode_release_data (inode);
+		inode_forget_data (inode);
+		free (inode);
 	}
 	return success;
 }
@@ -125,7 +570,13 @@ inode_open (disk_sector_t sector) {
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	lock_init (&inode->grow_lock);
+	if (!inode_read_back (inode)) {
+		list_remove (&inode->elem);
+		inode_forget_data (inode);
+		free (inode);
+		return NULL;
+	}
 	return inode;
 }
 
@@ -159,11 +610,11 @@ inode_close (struct inode *inode) {
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
-			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+			inode_release_sector (inode->sector);
+			inode_release_data (inode);
 		}
 
+		inode_forget_data (inode);
 		free (inode); 
 	}
 }
@@ -183,7 +634,6 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
@@ -200,46 +650,83 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		/* Copy the chunk out of the buffer cache. */
+		page_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
+/* Starts loading the sectors that hold LENGTH bytes of INODE at OFFSET
+ * into the buffer cache in the background.  Bytes past the end of INODE
+ * are ignored. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t length) {
+	off_t end = offset + length;
+	off_t pos;
+
+	if (end > inode_length (inode))
+		end = inode_length (inode);
+	for (pos = ROUND_DOWN (offset, DISK_SECTOR_SIZE); pos < end;
+			pos += DISK_SECTOR_SIZE)
+		page_cache_prefetch (byte_to_sector (inode, pos));
+}
+
+/* Returns true if every sector that holds LENGTH bytes of INODE at OFFSET
+ * is in the buffer cache, so that reading them waits for no disk.  Bytes
+ * past the end of INODE are ignored. */
+bool
+inode_is_cached (struct inode *inode, off_t offset, off_t length) {
+	off_t end = offset + length;
+	off_t pos;
+
+	if (end > inode_length (inode))
+		end = inode_length (inode);
+	for (pos = ROUND_DOWN (offset, DISK_SECTOR_SIZE); pos < end;
+			pos += DISK_SECTOR_SIZE)
+		if (!page_cache_contains (byte_to_sector (inode, pos)))
+			return false;
+	return true;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up or an error occurs.
+ * A write past end of file extends the inode first; any gap
+ * before OFFSET reads back as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
 
 	if (inode->deny_write_cnt)
 		return 0;
 
+	if (size > 0 && offset + size > inode->data.length) {
+		off_t end = offset + size;
+
+		lock_acquire (&inode->grow_lock);
+		if (end > inode->data.length) {
+			/* Whatever was allocated is written back, even if the
+			 * disk filled up before END. */
+			if (!inode_grow (inode, end)) {
+				off_t room = (off_t) inode_allocated (inode) * DISK_SECTOR_SIZE;
+				end = room < end ? room : end;
+			}
+			if (end > inode->data.length)
+				inode->data.length = end;
+			inode_write_back (inode);
+		}
+		lock_release (&inode->grow_lock);
+	}
+
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
@@ -255,34 +742,16 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* Copy the chunk into the buffer cache.  The sector is read
+		   from disk first unless the chunk covers all of it. */
+		page_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_written;
 }
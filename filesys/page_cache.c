@@ -1,6 +1,400 @@
-/* page_cache.c: Implementation of Page Cache (Buffer Cache). */
+/* page_cache.c: Implementation of Page Cache (Buffer Cache).
+ *
+ * Every sector of the file system disk is read and written through a
+ * fixed-size cache of CACHE_SIZE sectors.  Replacement is LRU-2: the entry
+ * whose second most recent use is oldest is evicted first, so a sector that
+ * was used only once (a sequential scan) goes before a sector that is used
+ * again and again (a directory, an inode, the free map).
+ *
+ * Dirty sectors are written back by kworkerd once they have been dirty for
+ * DIRTY_EXPIRE_MS, in ascending sector order with adjacent sectors written
+ * together.  Eviction prefers clean entries, so a reader or writer only has
+ * to write a dirty sector itself when every unpinned entry is dirty.
+ *
+ * Sequential file reads queue the sectors that follow for readaheadd, which
+ * loads them in the background.  A read that finds its sector still being
+ * loaded waits on the entry's lock instead of reading the disk again. */
 
+#include "filesys/page_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 #include "vm/vm.h"
+
+#define CACHE_SIZE 64
+
+/* kworkerd 는 FLUSH_INTERVAL_MS 마다 깨어나 DIRTY_EXPIRE_MS 이상 dirty 였던
+ * 섹터를 디스크에 쓴다. */
+#define FLUSH_INTERVAL_MS 500
+#define DIRTY_EXPIRE_MS 1000
+
+/* readaheadd 가 읽을 섹터를 담는 큐의 크기.  넘치면 요청을 버린다. */
+#define RA_QUEUE_SIZE 64
+
+/* 캐시 한 칸.  sector, valid, pin_cnt, ref 는 cache_lock 으로,
+ * data 와 dirty 는 entry 의 lock 으로 보호한다. */
+struct cache_entry {
+	disk_sector_t sector;               /* 담고 있는 섹터 */
+	bool valid;                         /* sector 가 유효한지 */
+	bool dirty;                         /* 디스크에 아직 쓰지 않은 내용이 있는지 */
+	int64_t dirty_since;                /* 처음 dirty 가 된 시각 (ticks) */
+	int pin_cnt;                        /* 이 칸을 쓰거나 기다리는 스레드 수 */
+	uint64_t ref[2];                    /* 가장 최근, 그 전의 참조 시각 (LRU-2) */
+	struct lock lock;
+	uint8_t data[DISK_SECTOR_SIZE];
+};
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static uint64_t cache_clock;            /* 참조 시각으로 쓰는 논리 시계 */
+
+/* 내보낼 섹터를 섹터 순서대로 모아 두는 버퍼.  flush_lock 으로 보호한다. */
+static struct lock flush_lock;
+static uint8_t flush_buf[CACHE_SIZE][DISK_SECTOR_SIZE];
+
+/* readahead 요청 큐.  ra_lock 으로 보호하고, 쌓인 요청 수만큼 ra_sema 를
+ * 올린다. */
+static struct lock ra_lock;
+static struct semaphore ra_sema;
+static disk_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head, ra_tail;
+
+/* 캐시 통계 */
+static long long cache_hit_cnt;         /* 캐시에서 찾은 섹터 수 */
+static long long cache_miss_cnt;        /* 캐시에 없던 섹터 수 */
+static long long cache_noread_cnt;      /* 섹터 전체를 덮어써서 읽지 않은 miss 수 */
+static long long cache_writeback_cnt;   /* evict 하면서 직접 쓴 dirty 섹터 수 */
+static long long flush_sector_cnt;      /* kworkerd 와 flush 가 쓴 섹터 수 */
+static long long flush_run_cnt;         /* 그 때 이어 쓴 연속 구간 수 */
+static long long ra_read_cnt;           /* readaheadd 가 미리 읽은 섹터 수 */
+static long long ra_drop_cnt;           /* 큐가 넘쳐 버린 readahead 요청 수 */
+
+static void page_cache_kworkerd (void *aux);
+static void page_cache_readaheadd (void *aux);
+
+/* Initializes the buffer cache. */
+void
+page_cache_init (void) {
+	lock_init (&cache_lock);
+	lock_init (&flush_lock);
+	lock_init (&ra_lock);
+	sema_init (&ra_sema, 0);
+	for (int i = 0; i < CACHE_SIZE; i++) {
+		cache[i].valid = false;
+		lock_init (&cache[i].lock);
+	}
+	pagecache_init ();
+	thread_create ("readaheadd", PRI_DEFAULT, page_cache_readaheadd, NULL);
+}
+
+/* Records a use of E.  The cache lock must be held. */
+static void
+cache_touch (struct cache_entry *e) {
+	e->ref[1] = e->ref[0];
+	e->ref[0] = ++cache_clock;
+}
+
+/* Returns the entry holding SECTOR, or NULL.  The cache lock must be
+ * held. */
+static struct cache_entry *
+cache_lookup (disk_sector_t sector) {
+	for (int i = 0; i < CACHE_SIZE; i++)
+		if (cache[i].valid && cache[i].sector == sector)
+			return &cache[i];
+	return NULL;
+}
+
+/* Returns true if A should be evicted before B under LRU-2. */
+static bool
+cache_older (const struct cache_entry *a, const struct cache_entry *b) {
+	return a->ref[1] < b->ref[1]
+		|| (a->ref[1] == b->ref[1] && a->ref[0] < b->ref[0]);
+}
+
+/* Chooses the entry to reuse: an empty one if any, otherwise the unpinned
+ * entry with the oldest second most recent use, ties broken by the most
+ * recent use.  Clean entries are taken before dirty ones, which are left to
+ * kworkerd.  Returns NULL if every entry is pinned.  The cache lock must be
+ * held. */
+static struct cache_entry *
+cache_victim (void) {
+	struct cache_entry *clean = NULL, *dirty = NULL;
+
+	for (int i = 0; i < CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[i];
+
+		if (!e->valid)
+			return e;
+		/* pin 되지 않은 칸은 lock 을 잡은 스레드가 없으므로 dirty 를 바로
+		 * 읽어도 된다. */
+		if (e->pin_cnt > 0)
+			continue;
+		if (!e->dirty) {
+			if (clean == NULL || cache_older (e, clean))
+				clean = e;
+		} else if (dirty == NULL || cache_older (e, dirty))
+			dirty = e;
+	}
+	return clean != NULL ? clean : dirty;
+}
+
+/* Writes E back if it is dirty.  E's lock must be held. */
+static void
+cache_writeback (struct cache_entry *e) {
+	if (e->dirty) {
+		disk_write (filesys_disk, e->sector, e->data);
+		e->dirty = false;
+		cache_writeback_cnt++;
+	}
+}
+
+/* Returns the locked entry holding SECTOR, loading it from disk first if
+ * LOAD is true.  Release it with cache_put().  A PREFETCH request returns
+ * NULL if SECTOR is already cached, and is left out of the statistics. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool load, bool prefetch) {
+	struct cache_entry *e;
+
+	for (;;) {
+		lock_acquire (&cache_lock);
+		e = cache_lookup (sector);
+		if (e != NULL && prefetch) {
+			lock_release (&cache_lock);
+			return NULL;
+		}
+		if (e != NULL) {
+			e->pin_cnt++;
+			cache_touch (e);
+			cache_hit_cnt++;
+			lock_release (&cache_lock);
+
+			/* 다른 스레드가 읽어 오는 중이면 끝날 때까지 기다린다. */
+			lock_acquire (&e->lock);
+			return e;
+		}
+
+		e = cache_victim ();
+		if (e == NULL) {
+			lock_release (&cache_lock);
+			thread_yield ();
+			continue;
+		}
+		/* pin 되지 않은 칸은 아무도 lock 을 잡고 있지 않으므로 바로 잡힌다. */
+		e->pin_cnt++;
+		lock_acquire (&e->lock);
+		if (!e->valid || !e->dirty)
+			break;
+
+		/* dirty 한 칸은 옛 섹터 그대로 pin 해 둔 채 cache lock 없이 쓴다.
+		 * 그 사이 옛 섹터를 찾은 스레드는 이 칸의 lock 을 기다렸다가 그대로
+		 * 쓰므로 디스크의 옛 내용을 읽지 않는다. */
+		lock_release (&cache_lock);
+		cache_writeback (e);
+		lock_acquire (&cache_lock);
+
+		/* 다른 스레드가 옛 섹터를 쓰려고 기다리거나, 그 사이 SECTOR 가 다른
+		 * 칸에 올라왔다면 이 칸은 포기하고 처음부터 다시 찾는다. */
+		if (e->pin_cnt == 1 && cache_lookup (sector) == NULL)
+			break;
+		e->pin_cnt--;
+		lock_release (&e->lock);
+		lock_release (&cache_lock);
+	}
+
+	e->sector = sector;
+	e->valid = true;
+	e->ref[0] = e->ref[1] = 0;
+	cache_touch (e);
+	if (!prefetch)
+		cache_miss_cnt++;
+	if (!load)
+		cache_noread_cnt++;
+	lock_release (&cache_lock);
+
+	if (load)
+		disk_read (filesys_disk, sector, e->data);
+	return e;
+}
+
+/* Releases E obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e) {
+	lock_release (&e->lock);
+	lock_acquire (&cache_lock);
+	e->pin_cnt--;
+	lock_release (&cache_lock);
+}
+
+/* Reads SIZE bytes at offset OFS of SECTOR into BUFFER. */
+void
+page_cache_read (disk_sector_t sector, void *buffer, int ofs, int size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, true, false);
+	memcpy (buffer, e->data + ofs, size);
+	cache_put (e);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS of SECTOR.  The sector is
+ * read first only if it is not overwritten entirely. */
+void
+page_cache_write (disk_sector_t sector, const void *buffer, int ofs,
+		int size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, size < DISK_SECTOR_SIZE, false);
+	memcpy (e->data + ofs, buffer, size);
+	if (!e->dirty) {
+		e->dirty = true;
+		e->dirty_since = timer_ticks ();
+	}
+	cache_put (e);
+}
+
+/* Returns true if SECTOR is in the cache, or being loaded into it, so that
+ * reading it does not start a disk read. */
+bool
+page_cache_contains (disk_sector_t sector) {
+	bool found;
+
+	lock_acquire (&cache_lock);
+	found = cache_lookup (sector) != NULL;
+	lock_release (&cache_lock);
+	return found;
+}
+
+/* Asks readaheadd to bring SECTOR into the cache.  Does not wait. */
+void
+page_cache_prefetch (disk_sector_t sector) {
+	lock_acquire (&ra_lock);
+	if (ra_tail - ra_head == RA_QUEUE_SIZE) {
+		ra_drop_cnt++;
+		lock_release (&ra_lock);
+		return;
+	}
+	ra_queue[ra_tail++ % RA_QUEUE_SIZE] = sector;
+	lock_release (&ra_lock);
+	sema_up (&ra_sema);
+}
+
+/* Readahead daemon.  Loads queued sectors that are not cached yet.  The
+ * entry stays locked while the disk is read, so that a foreground read of
+ * the same sector waits for this load. */
+static void
+page_cache_readaheadd (void *aux UNUSED) {
+	for (;;) {
+		struct cache_entry *e;
+		disk_sector_t sector;
+
+		sema_down (&ra_sema);
+		lock_acquire (&ra_lock);
+		sector = ra_queue[ra_head++ % RA_QUEUE_SIZE];
+		lock_release (&ra_lock);
+
+		e = cache_get (sector, true, true);
+		if (e != NULL) {
+			cache_put (e);
+			ra_read_cnt++;
+		}
+	}
+}
+
+static int
+entry_sector_compare (const void *a_, const void *b_) {
+	const struct cache_entry *a = *(struct cache_entry * const *) a_;
+	const struct cache_entry *b = *(struct cache_entry * const *) b_;
+
+	return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Writes back every sector that has been dirty for at least AGE ticks.
+ * The sectors are copied out in ascending order, so that the disk head
+ * sweeps one way, and adjacent sectors are written as one run.  They stay
+ * pinned until written, so that nobody reads a stale copy from the disk
+ * after evicting the now clean entry. */
+static void
+cache_flush_older (int64_t age) {
+	struct cache_entry *batch[CACHE_SIZE];
+	bool copied[CACHE_SIZE];
+	int64_t now = timer_ticks ();
+	size_t cnt = 0, i, run;
+
+	lock_acquire (&flush_lock);
+	lock_acquire (&cache_lock);
+	for (i = 0; i < CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[i];
+
+		if (e->valid && e->dirty && now - e->dirty_since >= age) {
+			e->pin_cnt++;
+			batch[cnt++] = e;
+		}
+	}
+	lock_release (&cache_lock);
+
+	qsort (batch, cnt, sizeof *batch, entry_sector_compare);
+	for (i = 0; i < cnt; i++) {
+		struct cache_entry *e = batch[i];
+
+		lock_acquire (&e->lock);
+		copied[i] = e->dirty;
+		if (e->dirty) {
+			memcpy (flush_buf[i], e->data, DISK_SECTOR_SIZE);
+			e->dirty = false;
+		}
+		lock_release (&e->lock);
+	}
+
+	for (i = 0; i < cnt; i = run) {
+		if (!copied[i]) {
+			run = i + 1;
+			continue;
+		}
+		for (run = i + 1; run < cnt && copied[run]
+				&& batch[run]->sector == batch[run - 1]->sector + 1; run++)
+			continue;
+		disk_write_multiple (filesys_disk, batch[i]->sector, flush_buf[i],
+				run - i);
+		flush_sector_cnt += run - i;
+		flush_run_cnt++;
+	}
+
+	lock_acquire (&cache_lock);
+	for (i = 0; i < cnt; i++)
+		batch[i]->pin_cnt--;
+	lock_release (&cache_lock);
+	lock_release (&flush_lock);
+}
+
+/* Writes every dirty sector back to disk. */
+void
+page_cache_flush (void) {
+	cache_flush_older (0);
+}
+
+/* Prints buffer cache statistics. */
+void
+page_cache_print_stats (void) {
+	long long total = cache_hit_cnt + cache_miss_cnt;
+
+	printf ("Buffer cache: %lld hits, %lld misses (%lld%% hit ratio), "
+			"%lld disk reads avoided, %lld writebacks\n",
+			cache_hit_cnt, cache_miss_cnt,
+			total > 0 ? cache_hit_cnt * 100 / total : 0,
+			cache_hit_cnt + cache_noread_cnt, cache_writeback_cnt);
+	printf ("Buffer cache: %lld sectors flushed in %lld runs\n",
+			flush_sector_cnt, flush_run_cnt);
+	printf ("Buffer cache: %lld sectors read ahead, %lld requests dropped\n",
+			ra_read_cnt, ra_drop_cnt);
+}
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
@@ -18,7 +412,10 @@ tid_t page_cache_workerd;
 /* The initializer of file vm */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	/* vm_init() 과 page_cache_init() 양쪽에서 불릴 수 있다. */
+	if (page_cache_workerd == 0)
+		page_cache_workerd = thread_create ("kworkerd", PRI_DEFAULT,
+				page_cache_kworkerd, NULL);
 }
 
 /* Initialize the page cache */
@@ -46,5 +443,9 @@ page_cache_destroy (struct page *page) {
 
 /* Worker thread for page cache */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		timer_msleep (FLUSH_INTERVAL_MS);
+		cache_flush_older ((int64_t) DIRTY_EXPIRE_MS * TIMER_FREQ / 1000);
+	}
 }
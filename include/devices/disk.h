@@ -2,6 +2,9 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Size of a disk sector in bytes. */
@@ -15,6 +18,30 @@ typedef uint32_t disk_sector_t;
  * printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* Most sectors one command can transfer: a sector count of 0 means 256. */
+#define DISK_MAX_SECTORS 256
+
+/* A block I/O request: CNT sectors starting at SECTOR on DISK,
+ * moved to or from BUFFER.  Pass it to disk_submit(), which calls
+ * END_IO once the transfer is done. */
+struct bio {
+	struct disk *disk;
+	disk_sector_t sector;
+	size_t cnt;                 /* At most DISK_MAX_SECTORS. */
+	void *buffer;               /* CNT * DISK_SECTOR_SIZE bytes. */
+	bool write;                 /* To the disk? */
+	void (*end_io) (struct bio *);  /* Called from the disk's I/O thread. */
+	void *private;              /* For END_IO's use. */
+
+	/* Owned by the block layer. */
+	struct list_elem elem;      /* Channel queue element. */
+	struct bio *next;           /* Next bio merged into this request. */
+	size_t req_cnt;             /* Sectors in the merged request. */
+};
+
+/* -nodma: Use PIO even if bus master DMA is available. */
+extern bool disk_dma_disabled;
+
 void disk_init (void);
 void disk_print_stats (void);
 
@@ -22,6 +49,10 @@ struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multiple (struct disk *, disk_sector_t, void *, size_t cnt);
+void disk_write_multiple (struct disk *, disk_sector_t, const void *,
+		size_t cnt);
+void disk_submit (struct bio *);
 
 void 	register_disk_inspect_intr ();
 #endif /* devices/disk.h */
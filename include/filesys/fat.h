@@ -4,6 +4,7 @@
 #include "devices/disk.h"
 #include "filesys/file.h"
 #include <inttypes.h>
+#include <list.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -22,11 +23,15 @@ void fat_init (void);
 void fat_open (void);
 void fat_close (void);
 void fat_create (void);
-void fat_close (void);
+void fat_sync (void);
 
 cluster_t fat_create_chain (
     cluster_t clst /* Cluster # to stretch, 0: Create a new chain */
 );
+cluster_t fat_create_chain_multiple (
+    cluster_t clst, /* Cluster # to stretch, 0: Create a new chain */
+    size_t cnt      /* Number of clusters to add */
+);
 void fat_remove_chain (
     cluster_t clst, /* Cluster # to be removed */
     cluster_t pclst /* Previous cluster of clst, 0: clst is the start of chain */
@@ -34,5 +39,32 @@ void fat_remove_chain (
 cluster_t fat_get (cluster_t clst);
 void fat_put (cluster_t clst, cluster_t val);
 disk_sector_t cluster_to_sector (cluster_t clst);
+cluster_t sector_to_cluster (disk_sector_t sector);
+
+/* A run of LEN clusters, CLST onward, at positions POS onward of a chain. */
+struct fat_run {
+	uint32_t pos;
+	cluster_t clst;
+	uint32_t len;
+};
+
+/* Cache of the cluster chain starting at START, kept as runs sorted by
+ * position, so that the cluster at any position is found by binary
+ * search instead of by following the chain.  The runs are built on
+ * first use, extended when fat_create_chain() appends to the chain, and
+ * dropped when fat_remove_chain() or fat_put() changes it.  At most one
+ * cache may be kept for any chain. */
+struct fat_chain {
+	cluster_t start;
+	struct fat_run *runs;
+	size_t run_cnt;
+	size_t run_cap;
+	bool built;
+	struct list_elem elem;
+};
+
+void fat_chain_init (struct fat_chain *, cluster_t start);
+void fat_chain_destroy (struct fat_chain *);
+cluster_t fat_chain_get (struct fat_chain *, size_t pos);
 
 #endif /* filesys/fat.h */
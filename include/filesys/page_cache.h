@@ -1,6 +1,7 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <stdbool.h>
+#include "devices/disk.h"
 
 struct page;
 enum vm_type;
@@ -8,5 +9,13 @@ enum vm_type;
 struct page_cache {};
 
 void page_cache_init (void);
+void pagecache_init (void);
+void page_cache_read (disk_sector_t sector, void *buffer, int ofs, int size);
+void page_cache_write (disk_sector_t sector, const void *buffer, int ofs,
+		int size);
+bool page_cache_contains (disk_sector_t sector);
+void page_cache_prefetch (disk_sector_t sector);
+void page_cache_flush (void);
+void page_cache_print_stats (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
 #endif
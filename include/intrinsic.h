@@ -11,6 +11,28 @@ static __inline void lcr3(uint64_t val) {
 	__asm __volatile("movq %0, %%cr3" : : "r" (val));
 }
 
+__attribute__((always_inline))
+static __inline uint64_t rcr4(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr4,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr4(uint64_t val) {
+	__asm __volatile("movq %0, %%cr4" : : "r" (val) : "memory");
+}
+
+/* Executes CPUID for LEAF and returns ECX, the feature flags of
+   leaf 1 that we care about. */
+__attribute__((always_inline))
+static __inline uint32_t cpuid_ecx(uint32_t leaf) {
+	uint32_t eax = leaf, ebx, ecx = 0, edx;
+	__asm __volatile("cpuid"
+			: "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+	return ecx;
+}
+
 __attribute__((always_inline))
 static __inline void lgdt(const struct desc_ptr *dtr) {
 	__asm __volatile("lgdt %0" : : "m" (*dtr));
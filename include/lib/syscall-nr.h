@@ -36,6 +36,32 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Paging control. */
+	SYS_MADVISE,                /* Give advice about use of memory. */
+	SYS_MLOCK,                  /* Lock pages in memory. */
+	SYS_MUNLOCK,                /* Unlock pages. */
+	SYS_VMSTAT,                 /* Read a paging counter of this process. */
+};
+
+/* Advice values for madvise(). */
+enum {
+	MADV_NORMAL,                /* No special treatment. */
+	MADV_RANDOM,                /* Expect random access; no fault-around. */
+	MADV_SEQUENTIAL,            /* Expect sequential access; read ahead more. */
+	MADV_WILLNEED,              /* Will be needed soon; bring pages in now. */
+	MADV_DONTNEED,              /* Not needed; discard anonymous contents. */
+};
+
+/* Counters readable with vmstat(). */
+enum {
+	VMSTAT_MINOR_FAULTS,        /* Faults served without reading the disk. */
+	VMSTAT_MAJOR_FAULTS,        /* Faults that read a file or swap. */
+	VMSTAT_COW_FAULTS,          /* Writes that copied a shared frame. */
+	VMSTAT_STACK_FAULTS,        /* Faults that grew the stack. */
+	VMSTAT_RSS,                 /* Pages with a frame. */
+	VMSTAT_LOCKED,              /* Pages locked by mlock(). */
+	VMSTAT_SWAP,                /* Pages out in swap. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -26,7 +26,7 @@
 #define PDPE(la) ((((uint64_t) (la)) >> PDPESHIFT) & 0x1FF)
 #define PDX(la)  ((((uint64_t) (la)) >> PDXSHIFT) & 0x1FF)
 #define PTX(la)  ((((uint64_t) (la)) >> PTXSHIFT) & 0x1FF)
-#define PTE_ADDR(pte) ((uint64_t) (pte) & ~0xFFF)
+#define PTE_ADDR(pte) ((uint64_t) (pte) & PTE_ADDR_MASK)
 
 /* The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
@@ -34,12 +34,23 @@
    A PDE or PTE that is initialized to 0 will be interpreted as
    "not present", which is just fine. */
 #define PTE_FLAGS 0x00000000000000fffUL    /* Flag bits. */
-#define PTE_ADDR_MASK  0xffffffffffffff000UL /* Address bits. */
+#define PTE_ADDR_MASK  0x000ffffffffff000UL /* Address bits. */
 #define PTE_AVL   0x00000e00             /* Bits available for OS use. */
 #define PTE_P 0x1                        /* 1=present, 0=not present. */
 #define PTE_W 0x2                        /* 1=read/write, 0=read-only. */
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=2 MB page (PDEs only). */
+
+/* An entry that points to a lower-level table keeps the number of
+   present entries in that table in bits 52-61, which the CPU
+   ignores.  See threads/mmu.c. */
+#define PTE_CNT_SHIFT 52
+#define PTE_CNT_MASK (0x3ffUL << PTE_CNT_SHIFT)
+#define pte_cnt(pte) (((uint64_t) (pte) & PTE_CNT_MASK) >> PTE_CNT_SHIFT)
+
+/* Size of the page mapped by a PDE with PTE_PS set. */
+#define LARGE_PGSIZE (1UL << PDXSHIFT)
 
 #endif /* threads/pte.h */
@@ -116,6 +116,9 @@ struct thread {
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	struct file *exec_file;             /* lazy loading 을 위해 열어 둔 실행 파일 */
+	struct vm_acct vm_acct;             /* fault 수, RSS, working set */
+	uintptr_t user_rsp;                 /* 시스템 콜 진입 시의 유저 rsp */
 #endif
 
 	/* Owned by thread.c. */
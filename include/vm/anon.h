@@ -1,13 +1,20 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
+#include <stddef.h>
 #include "vm/vm.h"
 struct page;
 enum vm_type;
+struct zswap_entry;
 
 struct anon_page {
+	size_t swap_slot;           /* swap disk 의 slot 번호 (없으면 BITMAP_ERROR) */
+	struct zswap_entry *zswap;  /* 압축 메모리 tier 의 항목 (없으면 NULL) */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+size_t anon_write_slot (const void *kva, unsigned refs);
+void anon_release_slot (size_t slot);
+void anon_print_stats (void);
 
 #endif
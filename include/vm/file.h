@@ -5,8 +5,36 @@
 
 struct page;
 enum vm_type;
+struct supplemental_page_table;
 
 struct file_page {
+	struct file *file;          /* 매핑된 파일 (mmap_region 이 소유) */
+	struct mmap_region *region; /* 이 페이지가 속한 매핑 */
+	off_t ofs;                  /* 이 페이지가 시작하는 파일 오프셋 */
+	size_t read_bytes;          /* 파일에서 읽을 바이트 수 */
+	size_t zero_bytes;          /* 나머지를 0 으로 채울 바이트 수 */
+};
+
+/* mmap 으로 만들어진 하나의 매핑 영역. 프로세스의 spt 에 연결된다. */
+struct mmap_region {
+	void *addr;                 /* 매핑 시작 주소 */
+	size_t page_cnt;            /* 매핑된 페이지 수 */
+	struct file *file;          /* mmap 시 reopen 한 파일 */
+	struct list_elem elem;      /* supplemental_page_table.mmaps 의 원소 */
+
+	/* 순차 readahead 상태 */
+	void *ra_end;               /* 지난 readahead 구간의 끝 (다음 순차 fault 위치) */
+	size_t ra_pages;            /* 지난 readahead 구간의 페이지 수 */
+};
+
+/* lazy loading 시 페이지를 채울 파일 영역.
+ * uninit 페이지의 aux 로 전달되며, 로드가 끝나면 해제된다. */
+struct lazy_load_arg {
+	struct file *file;          /* 읽어 올 파일 */
+	struct mmap_region *region; /* mmap 페이지이면 그 매핑, 아니면 NULL */
+	off_t ofs;                  /* 파일 내 오프셋 */
+	size_t read_bytes;          /* 파일에서 읽을 바이트 수 */
+	size_t zero_bytes;          /* 나머지를 0 으로 채울 바이트 수 */
 };
 
 void vm_file_init (void);
@@ -14,4 +42,7 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+void do_munmap_all (struct supplemental_page_table *spt);
+struct mmap_region *file_page_region (struct page *page);
+void file_print_stats (void);
 #endif
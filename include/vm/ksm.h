@@ -0,0 +1,18 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+#include <stddef.h>
+
+struct frame;
+
+/* Number of frames ksmd examines per pass.  0 disables ksmd.
+ * Controlled by kernel command-line option "-ksm=N". */
+extern size_t ksm_pages_to_scan;
+
+void ksm_init (void);
+void ksm_get_frame (struct frame *frame);
+void ksm_put_frame (struct frame *frame);
+void ksm_forget_frame (struct frame *frame);
+void ksm_forget_candidate (struct frame *frame);
+void ksm_print_stats (void);
+
+#endif
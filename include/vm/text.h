@@ -0,0 +1,16 @@
+#ifndef VM_TEXT_H
+#define VM_TEXT_H
+#include <stdbool.h>
+
+struct page;
+struct frame;
+
+void vm_text_init (void);
+bool text_claim_page (struct page *page);
+bool text_is_cached (struct page *page);
+void text_get_frame (struct frame *frame);
+void text_put_frame (struct frame *frame);
+void text_forget_frame (struct frame *frame);
+void text_print_stats (void);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
+#include <list.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -24,6 +26,9 @@ enum vm_type {
 	VM_MARKER_END = (1 << 31),
 };
 
+#define VM_STACK VM_MARKER_0    /* 스택 페이지 */
+#define VM_TEXT VM_MARKER_1     /* 프로세스 간에 공유되는 읽기 전용 실행 코드 */
+
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
@@ -46,6 +51,14 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct hash_elem spt_elem;  /* spt 해시 테이블의 원소 */
+	struct thread *owner;       /* 이 페이지를 매핑한 스레드 (pml4 조회용) */
+	bool writable;              /* 유저가 쓰기 가능한 페이지인지 여부 */
+	bool prefaulted;            /* fault-around 로 미리 매핑된 뒤 아직 접근 확인 전 */
+	bool referenced;            /* wssd 가 accessed bit 를 지우며 옮겨 둔 접근 기록 */
+	bool mlocked;               /* mlock 으로 고정되어 eviction 대상에서 제외 */
+	int advice;                 /* madvise 로 받은 접근 패턴 (MADV_NORMAL 등) */
+	struct list_elem share_elem; /* 매핑한 공유 프레임의 sharers 리스트 원소 */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -59,10 +72,48 @@ struct page {
 	};
 };
 
+/* 프로세스별 paging 통계. struct thread 에 들어 있다. */
+struct vm_acct {
+	long long minor_faults;     /* 디스크를 읽지 않고 처리한 fault */
+	long long major_faults;     /* 파일이나 swap 디스크를 읽은 fault */
+	long long cow_faults;       /* 공유 프레임에 쓰려다 복사한 fault */
+	long long stack_faults;     /* 스택을 키운 fault */
+	size_t rss;                 /* 프레임이 매핑된 페이지 수 */
+	size_t locked;              /* mlock 으로 고정한 페이지 수 */
+	size_t swap;                /* swap disk 에 나가 있는 페이지 수 */
+	bool oom_killed;            /* OOM killer 가 종료시키기로 고른 프로세스 */
+
+	/* working set 추정 (wssd) */
+	unsigned wss_gen;           /* wss_cnt 를 센 표본 번호 */
+	size_t wss_cnt;             /* 그 표본에서 접근된 페이지 수 */
+};
+
+/* Controlled by kernel command-line option "-vmstat". */
+extern bool vm_acct_print;
+
+/* Largest size a user stack may grow to, in bytes.
+ * Controlled by kernel command-line option "-stack=KB". */
+extern size_t vm_stack_limit;
+
+/* Per-process limits on resident and swapped pages, 0 for none.
+ * Controlled by kernel command-line options "-rss=PAGES" and
+ * "-swaplimit=PAGES". */
+extern size_t vm_rss_limit;
+extern size_t vm_swap_limit;
+
 /* The representation of "frame" */
 struct frame {
 	void *kva;
 	struct page *page;
+	struct list_elem frame_elem;  /* frame table (clock 리스트)의 원소 */
+	bool pinned;                  /* true 이면 eviction 대상에서 제외 */
+	int share_cnt;                /* 공유 프레임을 매핑한 페이지 수 (private 이면 0) */
+	struct list sharers;          /* 공유 프레임을 매핑한 페이지들 (zero frame 제외) */
+	bool merged;                  /* ksmd 가 병합한 공유 프레임 */
+	uint64_t checksum;            /* ksmd 가 지난 검사에서 계산한 내용 해시 */
+	struct hash_elem ksm_elem;    /* ksmd unstable tree 의 원소 */
+	bool ksm_candidate;           /* unstable tree 에 들어 있음 */
+	struct thp *thp;              /* 속한 2 MB huge page, 없으면 NULL */
 };
 
 /* The function table for page operations.
@@ -85,6 +136,9 @@ struct page_operations {
  * We don't want to force you to obey any specific design for this struct.
  * All designs up to you for this. */
 struct supplemental_page_table {
+	struct hash pages;          /* va -> struct page 해시 테이블 */
+	struct list mmaps;          /* struct mmap_region 리스트 */
+	void *stack_bottom;         /* 스택에서 가장 낮은 페이지 */
 };
 
 #include "threads/thread.h"
@@ -108,5 +162,25 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
+void vm_free_frame (struct page *page);
+bool vm_map_shared_frame (struct page *page, struct frame *frame);
+void vm_print_stats (void);
+void vm_acct_print_exit (void);
+long long vm_acct_get (int counter);
+void vm_oom_check (void);
+bool vm_madvise (void *addr, size_t length, int advice);
+bool vm_mlock (void *addr, size_t length);
+bool vm_munlock (void *addr, size_t length);
+
+/* ksmd 와 공유 text 캐시가 frame table 을 다룰 때 쓰는 함수들 */
+void vm_frame_lock_acquire (void);
+void vm_frame_lock_release (void);
+struct frame *vm_frame_next (struct frame *frame);
+struct frame *vm_get_zero_frame (void);
+void vm_frame_init (struct frame *frame, void *kva);
+void vm_frame_add (struct frame *frame);
+void vm_frame_remove (struct frame *frame);
+void vm_frame_detach (struct frame *frame);
+void vm_frame_replace (struct frame *frame, struct frame *shared);
 
 #endif  /* VM_VM_H */
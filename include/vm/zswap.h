@@ -0,0 +1,13 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+
+struct page;
+
+void zswap_init (void);
+bool zswap_store (struct page *page, const void *kva);
+bool zswap_load (struct page *page, void *kva);
+void zswap_invalidate (struct page *page);
+void zswap_print_stats (void);
+
+#endif
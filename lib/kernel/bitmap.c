@@ -326,6 +326,27 @@ bitmap_write (const struct bitmap *b, struct file *file) {
 	off_t size = byte_cnt (b->bit_cnt);
 	return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes to FILE only the bytes of B that hold the CNT bits
+   starting at START, so that a change to a few bits rewrites
+   only the file sectors that hold them.  Return true if
+   successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+		size_t start, size_t cnt) {
+	off_t ofs, size;
+
+	ASSERT (b != NULL);
+	ASSERT (start <= b->bit_cnt);
+	ASSERT (start + cnt <= b->bit_cnt);
+
+	if (cnt == 0)
+		return true;
+	ofs = start / CHAR_BIT;
+	size = (start + cnt - 1) / CHAR_BIT + 1 - ofs;
+	return file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+		== size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -155,6 +155,26 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+int
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+mlock (const void *addr, size_t length) {
+	return syscall2 (SYS_MLOCK, addr, length);
+}
+
+int
+munlock (const void *addr, size_t length) {
+	return syscall2 (SYS_MUNLOCK, addr, length);
+}
+
+long long
+vmstat (int counter) {
+	return syscall1 (SYS_VMSTAT, counter);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
@@ -31,6 +31,7 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/ksm.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
@@ -147,24 +148,44 @@ static void
 paging_init (uint64_t mem_end) {
 	uint64_t *pml4, *pte;
 	int perm;
+	size_t large_cnt = 0, small_cnt = 0;
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
 	extern char start, _end_kernel_text;
+	uint64_t text_start = vtop (&start);
+	uint64_t text_end = vtop (&_end_kernel_text);
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
+	// Every 2 MB chunk that lies wholly in RAM and does not hold the
+	// read-only kernel text is mapped by a single large PDE.
 	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
 		uint64_t va = (uint64_t) ptov(pa);
 
+		if (pa % LARGE_PGSIZE == 0 && pa + LARGE_PGSIZE <= mem_end
+				&& (pa + LARGE_PGSIZE <= text_start || text_end <= pa)) {
+			if ((pte = pml4e_walk_pde (pml4, va, 1)) != NULL) {
+				*pte = pa | PTE_PS | PTE_P | PTE_W;
+				large_cnt++;
+				pa += LARGE_PGSIZE - PGSIZE;
+				continue;
+			}
+		}
+
 		perm = PTE_P | PTE_W;
 		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
 			perm &= ~PTE_W;
 
-		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
+		if ((pte = pml4e_walk (pml4, va, 1)) != NULL) {
 			*pte = pa | perm;
+			small_cnt++;
+		}
 	}
+	printf ("Kernel mapping: %zu 2 MB pages, %zu 4 kB pages.\n",
+			large_cnt, small_cnt);
 
 	// reload cr3
 	pml4_activate(0);
+	pml4_pcid_init ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -216,16 +237,32 @@ parse_options (char **argv) {
 #ifdef FILESYS
 		else if (!strcmp (name, "-f"))
 			format_filesys = true;
+		else if (!strcmp (name, "-nodma"))
+			disk_dma_disabled = true;
 #endif
 		else if (!strcmp (name, "-rs"))
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-nopcid"))
+			pml4_pcid_disabled = true;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-ksm"))
+			ksm_pages_to_scan = atoi (value);
+		else if (!strcmp (name, "-vmstat"))
+			vm_acct_print = true;
+		else if (!strcmp (name, "-stack"))
+			vm_stack_limit = (size_t) atoi (value) * 1024;
+		else if (!strcmp (name, "-rss"))
+			vm_rss_limit = atoi (value);
+		else if (!strcmp (name, "-swaplimit"))
+			vm_swap_limit = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -324,10 +361,19 @@ usage (void) {
 			"  -h                 Print this help message and power off.\n"
 			"  -q                 Power off VM after actions or on panic.\n"
 			"  -f                 Format file system disk during startup.\n"
+			"  -nodma             Move disk data by PIO instead of bus master DMA.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -nopcid            Flush the TLB on every address space switch.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -ksm=PAGES         Merge identical pages, scanning PAGES frames per pass.\n"
+			"  -vmstat            Print each process's page faults and RSS at exit.\n"
+			"  -stack=KB          Limit user stacks to KB kB (default 1024).\n"
+			"  -rss=PAGES         Limit each process to PAGES resident pages.\n"
+			"  -swaplimit=PAGES   Limit each process to PAGES pages in swap.\n"
 #endif
 			);
 	power_off ();
@@ -354,6 +400,9 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+#ifdef USERPROG
+	pml4_print_stats ();
+#endif
 #ifdef FILESYS
 	disk_print_stats ();
 #endif
@@ -362,4 +411,7 @@ print_stats (void) {
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	vm_print_stats ();
+#endif
 }
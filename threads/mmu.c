@@ -1,5 +1,7 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "threads/init.h"
 #include "threads/pte.h"
@@ -8,28 +10,42 @@
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Adds DELTA to the population count that ENTRY keeps for the table it
+ * points to.  ENTRY is null for the pml4 itself, which has no count. */
+static inline void
+pte_cnt_add (uint64_t *entry, int delta) {
+	if (entry != NULL) {
+		ASSERT ((int) pte_cnt (*entry) + delta >= 0);
+		*entry += (uint64_t) (int64_t) delta << PTE_CNT_SHIFT;
+	}
+}
+
 static uint64_t *
-pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
+pgdir_walk (uint64_t *pdp, const uint64_t va, int create, uint64_t *parent) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
-				if (new_page)
+				if (new_page) {
 					pdp[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
-				else
+					pte_cnt_add (parent, 1);
+				} else
 					return NULL;
 			} else
 				return NULL;
 		}
+		/* A 2 MB mapping has no page table below it. */
+		if (pdp[idx] & PTE_PS)
+			return NULL;
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
 }
 
 static uint64_t *
-pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
+pdpe_walk (uint64_t *pdpe, const uint64_t va, int create, uint64_t *parent) {
 	uint64_t *pte = NULL;
 	int idx = PDPE (va);
 	int allocated = 0;
@@ -40,17 +56,19 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
 				if (new_page) {
 					pdpe[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+					pte_cnt_add (parent, 1);
 					allocated = 1;
 				} else
 					return NULL;
 			} else
 				return NULL;
 		}
-		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create);
+		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create, &pdpe[idx]);
 	}
 	if (pte == NULL && allocated) {
 		palloc_free_page ((void *) ptov (PTE_ADDR (pdpe[idx])));
 		pdpe[idx] = 0;
+		pte_cnt_add (parent, -1);
 	}
 	return pte;
 }
@@ -79,7 +97,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
-		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), va, create);
+		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), va, create, &pml4e[idx]);
 	}
 	if (pte == NULL && allocated) {
 		palloc_free_page ((void *) ptov (PTE_ADDR (pml4e[idx])));
@@ -88,6 +106,42 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the next-level table that entry IDX of TABLE points to,
+ * allocating it first if it is missing and CREATE is true.  PARENT is
+ * the entry that points to TABLE. */
+static uint64_t *
+next_table (uint64_t *table, int idx, int create, uint64_t *parent) {
+	if (!(table[idx] & PTE_P)) {
+		uint64_t *new_page;
+
+		if (!create || (new_page = palloc_get_page (PAL_ZERO)) == NULL)
+			return NULL;
+		table[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		pte_cnt_add (parent, 1);
+	}
+	return ptov (PTE_ADDR (table[idx]));
+}
+
+/* Returns the page directory pointer table entry above the page
+ * directory that maps VA in PML4E, which must exist. */
+static uint64_t *
+pdpe_of (uint64_t *pml4e, const uint64_t va) {
+	uint64_t *pdpe = ptov (PTE_ADDR (pml4e[PML4 (va)]));
+	return &pdpe[PDPE (va)];
+}
+
+/* Returns the address of the page directory entry for virtual address
+ * VA in page map level 4, pml4, creating the tables above it if CREATE
+ * is true.  paging_init() uses it to install 2 MB kernel mappings. */
+uint64_t *
+pml4e_walk_pde (uint64_t *pml4e, const uint64_t va, int create) {
+	uint64_t *pdpe = next_table (pml4e, PML4 (va), create, NULL);
+	uint64_t *pgdir = pdpe ? next_table (pdpe, PDPE (va), create,
+			&pml4e[PML4 (va)]) : NULL;
+
+	return pgdir ? &pgdir[PDX (va)] : NULL;
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -122,7 +176,8 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		/* 2 MB kernel mappings have no PTEs to visit. */
+		if ((((uint64_t) pte) & PTE_P) && !(((uint64_t) pte) & PTE_PS))
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -155,55 +210,249 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	return true;
 }
 
+/* Page-table pages freed by pml4_destroy() are collected here and handed
+ * back to palloc in runs of contiguous pages. */
+#define PT_BATCH_SIZE 64
+
+struct pt_batch {
+	size_t cnt;
+	void *pages[PT_BATCH_SIZE];
+};
+
+static long long teardown_cnt;          /* pml4s destroyed. */
+static long long teardown_scan_cnt;     /* Entries examined by them. */
+static long long teardown_table_cnt;    /* Page-table pages freed. */
+
+static int
+page_addr_less (const void *a_, const void *b_) {
+	uintptr_t a = (uintptr_t) *(void * const *) a_;
+	uintptr_t b = (uintptr_t) *(void * const *) b_;
+	return a < b ? -1 : a > b;
+}
+
 static void
-pt_destroy (uint64_t *pt) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
+pt_batch_flush (struct pt_batch *b) {
+	size_t i, run;
+
+	qsort (b->pages, b->cnt, sizeof *b->pages, page_addr_less);
+	for (i = 0; i < b->cnt; i += run) {
+		for (run = 1; i + run < b->cnt; run++)
+			if ((uint8_t *) b->pages[i + run]
+					!= (uint8_t *) b->pages[i] + run * PGSIZE)
+				break;
+		palloc_free_multiple (b->pages[i], run);
+	}
+	teardown_table_cnt += b->cnt;
+	b->cnt = 0;
+}
+
+static void
+pt_batch_add (struct pt_batch *b, void *page) {
+	b->pages[b->cnt++] = page;
+	if (b->cnt == PT_BATCH_SIZE)
+		pt_batch_flush (b);
+}
+
+/* Each destroy function below is given the population count CNT of its
+ * table and stops scanning once it has seen that many present entries,
+ * so empty tables are freed without being read at all. */
+static void
+pt_destroy (uint64_t *pt, size_t cnt, struct pt_batch *b) {
+#ifndef VM
+	/* Without VM the user pages are owned by the page table. */
+	for (unsigned i = 0; cnt > 0 && i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pt[i]);
-		if (((uint64_t) pte) & PTE_P)
+		teardown_scan_cnt++;
+		if (((uint64_t) pte) & PTE_P) {
 			palloc_free_page ((void *) PTE_ADDR (pte));
+			cnt--;
+		}
 	}
-	palloc_free_page ((void *) pt);
+#else
+	/* With VM they belong to the frame table and are already freed. */
+	(void) cnt;
+#endif
+	pt_batch_add (b, pt);
 }
 
 static void
-pgdir_destroy (uint64_t *pdp) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
+pgdir_destroy (uint64_t *pdp, size_t cnt, struct pt_batch *b) {
+	for (unsigned i = 0; cnt > 0 && i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			pt_destroy (PTE_ADDR (pte));
+		teardown_scan_cnt++;
+		if (((uint64_t) pte) & PTE_P) {
+			/* The frames of a 2 MB page belong to the frame table. */
+			if (!(((uint64_t) pte) & PTE_PS))
+				pt_destroy ((uint64_t *) PTE_ADDR (pte), pte_cnt (pdp[i]), b);
+			cnt--;
+		}
 	}
-	palloc_free_page ((void *) pdp);
+	pt_batch_add (b, pdp);
 }
 
 static void
-pdpe_destroy (uint64_t *pdpe) {
-	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
+pdpe_destroy (uint64_t *pdpe, size_t cnt, struct pt_batch *b) {
+	for (unsigned i = 0; cnt > 0 && i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pde = ptov((uint64_t *) pdpe[i]);
-		if (((uint64_t) pde) & PTE_P)
-			pgdir_destroy ((void *) PTE_ADDR (pde));
+		teardown_scan_cnt++;
+		if (((uint64_t) pde) & PTE_P) {
+			pgdir_destroy ((void *) PTE_ADDR (pde), pte_cnt (pdpe[i]), b);
+			cnt--;
+		}
 	}
-	palloc_free_page ((void *) pdpe);
+	pt_batch_add (b, pdpe);
 }
 
 /* Destroys pml4e, freeing all the pages it references. */
 void
 pml4_destroy (uint64_t *pml4) {
+	struct pt_batch batch;
+
 	if (pml4 == NULL)
 		return;
 	ASSERT (pml4 != base_pml4);
 
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
+	batch.cnt = 0;
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
-		pdpe_destroy ((void *) PTE_ADDR (pdpe));
-	palloc_free_page ((void *) pml4);
+		pdpe_destroy ((void *) PTE_ADDR (pdpe), pte_cnt (pml4[0]), &batch);
+	pt_batch_add (&batch, pml4);
+	pt_batch_flush (&batch);
+	teardown_cnt++;
+}
+
+/* Process-context identifiers (PCIDs).
+ *
+ * With CR4.PCIDE set, TLB entries are tagged with the 12-bit PCID held in
+ * the low bits of CR3, so switching to another pml4 need not flush the TLB.
+ * PCID 0 belongs to base_pml4.  Other pml4s get a PCID the first time they
+ * are activated in the current generation; PCIDs are handed out in order
+ * and never reused within a generation.  When they run out, the generation
+ * advances, the whole TLB is flushed once, and every pml4 picks up a fresh
+ * PCID on its next activation.
+ *
+ * A pml4's tag lives in PML4 slot PCID_TAG_SLOT, which maps nothing (the
+ * kernel only uses slot 1) and is kept not-present, so the hardware and
+ * pml4_for_each() ignore it. */
+#define CPUID_PCID (1 << 17)            /* CPUID.01H:ECX, PCID supported. */
+#define CR4_PGE (1 << 7)                /* Global pages. */
+#define CR4_PCIDE (1 << 17)             /* PCID enable. */
+#define CR3_NOFLUSH (1ULL << 63)        /* Keep TLB entries of the PCID. */
+#define PCID_CNT 4096
+#define PCID_TAG_SLOT 511
+#define PCID_TAG(GEN, PCID) (((GEN) << 13) | ((uint64_t) (PCID) << 1))
+
+/* -nopcid: Flush the TLB on every switch, even if the CPU has PCIDs. */
+bool pml4_pcid_disabled;
+
+static bool pcid_enabled;
+static uint64_t pcid_gen = 1;           /* Generation 0 means "no tag". */
+static unsigned pcid_next = 1;          /* Next free PCID in the generation. */
+
+static long long pcid_hit_cnt;          /* Switches that kept the TLB. */
+static long long pcid_assign_cnt;       /* PCIDs handed out. */
+static long long pcid_rollover_cnt;     /* Generations exhausted. */
+
+/* Enables PCIDs if the CPU supports them and -nopcid was not given.
+ * Must be called with base_pml4 active, since CR3 must hold PCID 0 when
+ * CR4.PCIDE is set. */
+void
+pml4_pcid_init (void) {
+	if (pml4_pcid_disabled || !(cpuid_ecx (1) & CPUID_PCID))
+		return;
+	ASSERT (rcr3 () == vtop (base_pml4));
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_enabled = true;
+}
+
+/* Flushes every TLB entry of every PCID, global ones included. */
+static void
+tlb_flush_all (void) {
+	uint64_t cr4 = rcr4 ();
+	lcr4 (cr4 ^ CR4_PGE);
+	lcr4 (cr4);
+}
+
+/* Returns true if PML4 is loaded in CR3. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Makes sure no TLB entry of PML4 for VA survives a change to its PTE.
+ * A pml4 that is not loaded may still have entries under its PCID, so it
+ * drops its tag and gets a fresh, clean PCID on its next activation. */
+static void
+pml4_flush_page (uint64_t *pml4, const void *va) {
+	if (pml4_is_active (pml4))
+		invlpg ((uint64_t) va);
+	else if (pcid_enabled)
+		pml4[PCID_TAG_SLOT] = 0;
 }
 
 /* Loads page directory PD into the CPU's page directory base
  * register. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	uint64_t tag;
+	unsigned pcid;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	if (!pcid_enabled) {
+		lcr3 (vtop (pml4));
+		return;
+	}
+	if (pml4 == base_pml4) {
+		/* Kernel mappings never change, so PCID 0 is never flushed. */
+		lcr3 (vtop (pml4) | CR3_NOFLUSH);
+		return;
+	}
+
+	tag = pml4[PCID_TAG_SLOT];
+	if (tag >> 13 == pcid_gen) {
+		pcid = (tag >> 1) & (PCID_CNT - 1);
+		pcid_hit_cnt++;
+	} else {
+		if (pcid_next == PCID_CNT) {
+			pcid_gen++;
+			pcid_next = 1;
+			pcid_rollover_cnt++;
+			tlb_flush_all ();
+		}
+		pcid = pcid_next++;
+		pml4[PCID_TAG_SLOT] = PCID_TAG (pcid_gen, pcid);
+		pcid_assign_cnt++;
+	}
+	lcr3 (vtop (pml4) | pcid | CR3_NOFLUSH);
+}
+
+/* Prints PCID statistics. */
+void
+pml4_print_stats (void) {
+	if (pcid_enabled)
+		printf ("PCID: %lld switches kept the TLB, %lld PCIDs assigned, "
+				"%lld generations\n",
+				pcid_hit_cnt, pcid_assign_cnt, pcid_rollover_cnt + 1);
+	else
+		printf ("PCID: %s, every switch flushes the TLB\n",
+				pml4_pcid_disabled ? "disabled" : "not supported");
+	printf ("Teardown: %lld page tables, %lld entries scanned, "
+			"%lld table pages freed\n",
+			teardown_cnt, teardown_scan_cnt, teardown_table_cnt);
+}
+
+/* Returns the entry that maps VA in PML4: the page directory entry if VA
+ * lies in a 2 MB page, otherwise its page table entry, or a null pointer
+ * if there is no page table for VA. */
+static uint64_t *
+leaf_walk (uint64_t *pml4, const void *va) {
+	uint64_t *pde = pml4e_walk_pde (pml4, (uint64_t) va, 0);
+
+	if (pde != NULL && (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+		return pde;
+	return pml4e_walk (pml4, (uint64_t) va, false);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -214,11 +463,14 @@ void *
 pml4_get_page (uint64_t *pml4, const void *uaddr) {
 	ASSERT (is_user_vaddr (uaddr));
 
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
+	uint64_t *pte = leaf_walk (pml4, uaddr);
 
-	if (pte && (*pte & PTE_P))
-		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
-	return NULL;
+	if (pte == NULL || !(*pte & PTE_P))
+		return NULL;
+	if (*pte & PTE_PS)
+		return ptov (PTE_ADDR (*pte))
+			+ ((uint64_t) uaddr & (LARGE_PGSIZE - 1));
+	return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
 }
 
 /* Adds a mapping in page map level 4 PML4 from user virtual page
@@ -238,11 +490,65 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
-	if (pte)
+	if (pte) {
+		if (!(*pte & PTE_P))
+			pte_cnt_add (pml4e_walk_pde (pml4, (uint64_t) upage, 0), 1);
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	}
 	return pte != NULL;
 }
 
+/* Maps the 2 MB of physical memory at kernel virtual address KPAGE at
+ * user virtual address UPAGE in PML4 with a single large page.  Both must
+ * be 2 MB aligned and nothing in the range may be mapped yet; an empty
+ * page table left over there is freed.
+ * Returns true if successful, false if memory allocation failed. */
+bool
+pml4_set_large_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	ASSERT ((uint64_t) upage % LARGE_PGSIZE == 0);
+	ASSERT ((uint64_t) kpage % LARGE_PGSIZE == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	uint64_t *pde = pml4e_walk_pde (pml4, (uint64_t) upage, 1);
+	if (pde == NULL)
+		return false;
+
+	if (*pde & PTE_P) {
+		ASSERT (!(*pde & PTE_PS));
+		ASSERT (pte_cnt (*pde) == 0);
+		palloc_free_page (ptov (PTE_ADDR (*pde)));
+		*pde = 0;
+		pml4_flush_page (pml4, upage);
+	} else
+		pte_cnt_add (pdpe_of (pml4, (uint64_t) upage), 1);
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	return true;
+}
+
+/* Replaces the 2 MB page mapped at UPAGE in PML4 by the page table PT,
+ * a page from palloc_get_page(), whose entries map the same memory with
+ * the same permissions, accessed and dirty bits.
+ * Returns false, leaving PT unused, if UPAGE is not a 2 MB page. */
+bool
+pml4_split_large_page (uint64_t *pml4, void *upage, uint64_t *pt) {
+	ASSERT ((uint64_t) upage % LARGE_PGSIZE == 0);
+	ASSERT (is_user_vaddr (upage));
+
+	uint64_t *pde = pml4e_walk_pde (pml4, (uint64_t) upage, 0);
+	if (pde == NULL || (*pde & (PTE_P | PTE_PS)) != (PTE_P | PTE_PS))
+		return false;
+
+	uint64_t pa = PTE_ADDR (*pde);
+	uint64_t flags = *pde & (PTE_P | PTE_W | PTE_U | PTE_A | PTE_D);
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P
+		| ((uint64_t) (PGSIZE / sizeof(uint64_t *)) << PTE_CNT_SHIFT);
+	pml4_flush_page (pml4, upage);
+	return true;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
@@ -257,18 +563,19 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		pte_cnt_add (pml4e_walk_pde (pml4, (uint64_t) upage, 0), -1);
+		pml4_flush_page (pml4, upage);
 	}
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
- * installed.
+ * installed.  For a page inside a 2 MB page, the bit is the one
+ * that all of its 4 kB pages share.
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = leaf_walk (pml4, vpage);
 	return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -276,25 +583,25 @@ pml4_is_dirty (uint64_t *pml4, const void *vpage) {
  * in PML4. */
 void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = leaf_walk (pml4, vpage);
 	if (pte) {
 		if (dirty)
 			*pte |= PTE_D;
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		pml4_flush_page (pml4, vpage);
 	}
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 has been
  * accessed recently, that is, between the time the PTE was
- * installed and the last time it was cleared.  Returns false if
+ * installed and the last time it was cleared.  As with
+ * pml4_is_dirty(), a 2 MB page has a single bit.  Returns false if
  * PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_accessed (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = leaf_walk (pml4, vpage);
 	return pte != NULL && (*pte & PTE_A) != 0;
 }
 
@@ -302,14 +609,16 @@ pml4_is_accessed (uint64_t *pml4, const void *vpage) {
    VPAGE in PD. */
 void
 pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = leaf_walk (pml4, vpage);
 	if (pte) {
 		if (accessed)
 			*pte |= PTE_A;
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
+		/* A stale TLB entry only keeps the CPU from setting the
+		 * accessed bit again, so another pml4 keeps its PCID. */
+		if (pml4_is_active (pml4))
 			invlpg ((uint64_t) vpage);
 	}
 }
@@ -284,6 +284,42 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	return pages;
 }
 
+/* Obtains and returns a group of PAGE_CNT contiguous free pages
+   whose address is a multiple of PAGE_CNT pages, such as a 2 MB
+   block for a large page.  PAGE_CNT must be a power of two.
+   FLAGS are interpreted as in palloc_get_multiple(). */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t page_idx;
+	void *pages = NULL;
+
+	ASSERT (page_cnt > 0 && (page_cnt & (page_cnt - 1)) == 0);
+
+	/* The pool base is only page aligned, so start from the first
+	   index whose address is aligned and step by whole blocks. */
+	page_idx = (page_cnt - pg_no (pool->base) % page_cnt) % page_cnt;
+	lock_acquire (&pool->lock);
+	for (; page_idx + page_cnt <= bitmap_size (pool->used_map);
+			page_idx += page_cnt)
+		if (!bitmap_contains (pool->used_map, page_idx, page_cnt, true)) {
+			bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+			pages = pool->base + PGSIZE * page_idx;
+			break;
+		}
+	lock_release (&pool->lock);
+
+	if (pages) {
+		if (flags & PAL_ZERO)
+			memset (pages, 0, PGSIZE * page_cnt);
+	} else {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get: out of pages");
+	}
+
+	return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -328,6 +364,12 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void) {
+	return bitmap_size (user_pool.used_map);
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -13,6 +13,7 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
@@ -125,6 +126,12 @@ __do_fork (void *aux) {
 	struct intr_frame *parent_if;
 	bool succ = true;
 
+#ifdef VM
+	/* 실패하면 process_cleanup () 이 spt 를 정리하므로 처음 실패할 수
+	 * 있는 곳보다 먼저 초기화한다. */
+	supplemental_page_table_init (&current->spt);
+#endif
+
 	/* 1. Read the cpu context to local stack. */
 	memcpy (&if_, parent_if, sizeof (struct intr_frame));
 
@@ -135,7 +142,6 @@ __do_fork (void *aux) {
 
 	process_activate (current);
 #ifdef VM
-	supplemental_page_table_init (&current->spt);
 	if (!supplemental_page_table_copy (&current->spt, &parent->spt))
 		goto error;
 #else
@@ -216,6 +222,10 @@ process_exit (void) {
 	 * TODO: project2/process_termination.html).
 	 * TODO: We recommend you to implement process resource cleanup here. */
 
+#ifdef VM
+	if (curr->pml4 != NULL)
+		vm_acct_print_exit ();
+#endif
 	process_cleanup ();
 }
 
@@ -225,7 +235,9 @@ process_cleanup (void) {
 	struct thread *curr = thread_current ();
 
 #ifdef VM
-	supplemental_page_table_kill (&curr->spt);
+	/* mmap 된 파일은 PTE 의 dirty bit 를 보고 되돌려 써야 하므로
+	 * pml4 를 떼어내기 전에 정리한다. */
+	do_munmap_all (&curr->spt);
 #endif
 
 	uint64_t *pml4;
@@ -242,8 +254,17 @@ process_cleanup (void) {
 		 * that's been freed (and cleared). */
 		curr->pml4 = NULL;
 		pml4_activate (NULL);
-		pml4_destroy (pml4);
 	}
+
+#ifdef VM
+	/* pml4 가 없으므로 남은 페이지는 PTE 를 하나씩 지우지 않고 프레임과
+	 * spt 원소만 해제된다. 페이지 테이블은 아래에서 한 번에 버린다. */
+	supplemental_page_table_kill (&curr->spt);
+	file_close (curr->exec_file);
+	curr->exec_file = NULL;
+#endif
+
+	pml4_destroy (pml4);
 }
 
 /* Sets up the CPU for running user code in the nest thread.
@@ -341,6 +362,12 @@ load (const char *file_name, struct intr_frame *if_) {
 		printf ("load: %s: open failed\n", file_name);
 		goto done;
 	}
+#ifdef VM
+	/* 세그먼트는 lazy 하게 로드되므로 프로세스가 끝날 때까지 열어 둔다.
+	 * 실행 중에는 쓰기를 막아 공유 text 캐시의 내용이 바뀌지 않게 한다. */
+	t->exec_file = file;
+	file_deny_write (file);
+#endif
 
 	/* Read and verify executable header. */
 	if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -421,7 +448,9 @@ load (const char *file_name, struct intr_frame *if_) {
 
 done:
 	/* We arrive here whether the load is successful or not. */
+#ifndef VM
 	file_close (file);
+#endif
 	return success;
 }
 
@@ -576,9 +605,16 @@ install_page (void *upage, void *kpage, bool writable) {
 
 static bool
 lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
+	struct lazy_load_arg *arg = aux;
+	uint8_t *kva = page->frame->kva;
+	bool success;
+
+	success = file_read_at (arg->file, kva, arg->read_bytes, arg->ofs)
+		== (off_t) arg->read_bytes;
+	if (success)
+		memset (kva + arg->read_bytes, 0, arg->zero_bytes);
+	free (arg);
+	return success;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -609,16 +645,35 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
-			return false;
+		if (page_read_bytes == 0) {
+			/* 파일에서 읽을 내용이 없는 bss 페이지는 초기화 함수 없이
+			 * 익명 페이지로 만들어 zero frame 으로 처리되게 한다. */
+			if (!vm_alloc_page (VM_ANON, upage, writable))
+				return false;
+		} else {
+			struct lazy_load_arg *aux = malloc (sizeof *aux);
+			if (aux == NULL)
+				return false;
+			aux->file = file;
+			aux->region = NULL;
+			aux->ofs = ofs;
+			aux->read_bytes = page_read_bytes;
+			aux->zero_bytes = page_zero_bytes;
+			/* 읽기 전용 세그먼트는 같은 실행 파일을 돌리는 프로세스끼리
+			 * 프레임을 공유할 수 있다. */
+			if (!vm_alloc_page_with_initializer (
+						writable ? VM_ANON : VM_ANON | VM_TEXT, upage,
+						writable, lazy_load_segment, aux)) {
+				free (aux);
+				return false;
+			}
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
+		ofs += page_read_bytes;
 	}
 	return true;
 }
@@ -629,11 +684,14 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-
+	/* 스택의 첫 페이지는 인자 전달에 바로 쓰이므로 즉시 할당한다. */
+	if (vm_alloc_page (VM_ANON | VM_STACK, stack_bottom, true)) {
+		success = vm_claim_page (stack_bottom);
+		if (success) {
+			if_->rsp = USER_STACK;
+			thread_current ()->spt.stack_bottom = stack_bottom;
+		}
+	}
 	return success;
 }
 #endif /* VM */
@@ -7,6 +7,9 @@
 #include "userprog/gdt.h"
 #include "threads/flags.h"
 #include "intrinsic.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
@@ -40,6 +43,35 @@ syscall_init (void) {
 /* The main system call interface */
 void
 syscall_handler (struct intr_frame *f UNUSED) {
+#ifdef VM
+	/* 커널 안에서 유저 스택에 fault 가 나면 이 값으로 스택 접근인지 판단한다. */
+	thread_current ()->user_rsp = f->rsp;
+	vm_oom_check ();
+
+	/* 인자는 rdi, rsi, rdx 순서로, 결과는 rax 로 돌려준다. */
+	switch (f->R.rax) {
+		case SYS_MADVISE:
+			f->R.rax = vm_madvise ((void *) f->R.rdi, f->R.rsi, f->R.rdx)
+				? 0 : -1;
+			break;
+		case SYS_MLOCK:
+			f->R.rax = vm_mlock ((void *) f->R.rdi, f->R.rsi) ? 0 : -1;
+			break;
+		case SYS_MUNLOCK:
+			f->R.rax = vm_munlock ((void *) f->R.rdi, f->R.rsi) ? 0 : -1;
+			break;
+		case SYS_VMSTAT:
+			f->R.rax = vm_acct_get (f->R.rdi);
+			break;
+		default:
+			goto unhandled;
+	}
+	/* 시스템 콜 도중 OOM killer 에게 골랐으면 유저 모드로 돌아가기 전에
+	 * 종료한다. */
+	vm_oom_check ();
+	return;
+unhandled:
+#endif
 	// TODO: Your implementation goes here.
 	printf ("system call!\n");
 	thread_exit ();
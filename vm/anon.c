@@ -1,7 +1,13 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <bitmap.h>
+#include <stdio.h>
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +23,145 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* 페이지 하나를 담는 데 필요한 섹터 수 */
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
+
+/* swap disk 의 slot 사용 여부. slot 하나가 페이지 하나 */
+static struct bitmap *swap_table;
+/* slot 마다 그 slot 을 가리키는 페이지 수. 공유 프레임을 내보내면 여럿이 된다. */
+static unsigned *slot_refs;
+static struct lock swap_lock;
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	size_t slot_cnt;
+
+	swap_disk = disk_get (1, 1);
+	slot_cnt = swap_disk != NULL ? disk_size (swap_disk) / SECTORS_PER_PAGE : 0;
+	swap_table = bitmap_create (slot_cnt);
+	slot_refs = calloc (slot_cnt, sizeof *slot_refs);
+	if (swap_table == NULL || (slot_cnt > 0 && slot_refs == NULL))
+		PANIC ("swap table creation failed");
+	lock_init (&swap_lock);
+	zswap_init ();
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
+	/* KVA 는 zero frame 일 수 있으므로 여기서 내용을 건드리지 않는다. */
 	struct anon_page *anon_page = &page->anon;
+	anon_page->swap_slot = BITMAP_ERROR;
+	anon_page->zswap = NULL;
+	return true;
+}
+
+/* Writes the page contents at KVA to a free swap slot that REFS pages will
+ * refer to, and returns the slot, or BITMAP_ERROR if the swap disk is
+ * full. */
+size_t
+anon_write_slot (const void *kva, unsigned refs) {
+	size_t slot;
+
+	ASSERT (refs > 0);
+
+	lock_acquire (&swap_lock);
+	slot = bitmap_scan_and_flip (swap_table, 0, 1, false);
+	if (slot != BITMAP_ERROR)
+		slot_refs[slot] = refs;
+	lock_release (&swap_lock);
+	if (slot == BITMAP_ERROR)
+		return BITMAP_ERROR;
+
+	disk_write_multiple (swap_disk, slot * SECTORS_PER_PAGE, kva,
+			SECTORS_PER_PAGE);
+	return slot;
+}
+
+/* Drops one page's reference to SLOT, freeing it with the last one. */
+void
+anon_release_slot (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (slot_refs[slot] > 0);
+	if (--slot_refs[slot] == 0)
+		bitmap_reset (swap_table, slot);
+	lock_release (&swap_lock);
+}
+
+/* Writes the page contents at KVA to a free swap slot and records the slot
+ * in PAGE.  Returns false if the swap disk is full. */
+static bool
+anon_swap_to_disk (struct page *page, const void *kva) {
+	size_t slot = anon_write_slot (kva, 1);
+
+	if (slot == BITMAP_ERROR)
+		return false;
+	page->anon.swap_slot = slot;
+	page->owner->vm_acct.swap++;
+	return true;
+}
+
+/* Releases PAGE's swap slot, if any. */
+static void
+anon_free_slot (struct page *page) {
+	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->swap_slot == BITMAP_ERROR)
+		return;
+
+	anon_release_slot (anon_page->swap_slot);
+	anon_page->swap_slot = BITMAP_ERROR;
+	page->owner->vm_acct.swap--;
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+
+	/* 압축 tier 에 있으면 디스크를 읽지 않고 풀어서 복원한다. */
+	if (zswap_load (page, kva))
+		return true;
+
+	if (anon_page->swap_slot == BITMAP_ERROR)
+		return false;
+	disk_read_multiple (swap_disk, anon_page->swap_slot * SECTORS_PER_PAGE,
+			kva, SECTORS_PER_PAGE);
+	anon_free_slot (page);
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	void *kva = page->frame->kva;
+
+	/* 먼저 압축 tier 에 넣어 보고, 안 되면 swap disk 로 보낸다. */
+	if (zswap_store (page, kva))
+		return true;
+	return anon_swap_to_disk (page, kva);
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	zswap_invalidate (page);
+	anon_free_slot (page);
+	vm_free_frame (page);
+}
+
+/* Prints swap statistics. */
+void
+anon_print_stats (void) {
+	lock_acquire (&swap_lock);
+	printf ("Swap: %zu of %zu slots in use\n",
+			bitmap_count (swap_table, 0, bitmap_size (swap_table), true),
+			bitmap_size (swap_table));
+	lock_release (&swap_lock);
+	zswap_print_stats ();
 }
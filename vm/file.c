@@ -1,10 +1,51 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 
+/* flushd 는 WB_INTERVAL_MS 마다 frame table 을 훑어 dirty 한 파일 페이지를
+ * 모아 파일에 써 둔다.  munmap 과 종료 시에는 그 뒤에 다시 더러워진
+ * 페이지만 쓰면 된다. */
+#define WB_INTERVAL_MS 500
+#define WB_BATCH_PAGES 32
+
+/* flushd 가 한 번에 모은 dirty 페이지 하나. */
+struct wb_entry {
+	struct file *file;
+	off_t ofs;
+	size_t bytes;
+	void *kva;
+	uint64_t *pml4;
+	void *va;
+};
+
+/* 파일 쓰기의 순서를 지킨다.  flushd 가 복사해 둔 내용을 쓰는 동안
+ * 동기 writeback 이 더 새 내용을 먼저 쓰지 못하게 하고, 그 동안 파일이
+ * 닫히지 않게 한다.  frame lock 보다 뒤에 잡는다. */
+static struct lock writeback_lock;
+
+static struct wb_entry wb_batch[WB_BATCH_PAGES];
+static uint8_t *wb_buffer;          /* 연속 구간을 모아 쓰는 bounce buffer */
+
+/* writeback 통계 */
+static long long wb_page_cnt;       /* flushd 가 쓴 페이지 수 */
+static long long wb_write_cnt;      /* 그 때 호출한 file_write_at 횟수 */
+static long long wb_sync_cnt;       /* munmap, 종료, evict 시 직접 쓴 페이지 수 */
+
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
+static void flushd (void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations file_ops = {
@@ -17,42 +58,293 @@ static const struct page_operations file_ops = {
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	lock_init (&writeback_lock);
+	wb_buffer = palloc_get_multiple (PAL_ASSERT, WB_BATCH_PAGES);
+	thread_create ("flushd", PRI_MIN, flushd, NULL);
 }
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
+	/* uninit 과 file_page 는 union 을 공유하므로 aux 를 먼저 읽어 둔다. */
+	struct lazy_load_arg *arg = page->uninit.aux;
+
 	/* Set up the handler */
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	file_page->file = arg->file;
+	file_page->region = arg->region;
+	file_page->ofs = arg->ofs;
+	file_page->read_bytes = arg->read_bytes;
+	file_page->zero_bytes = arg->zero_bytes;
+	return true;
+}
+
+/* Writes PAGE back to its file if the user modified it. */
+static void
+file_backed_writeback (struct page *page) {
+	struct file_page *file_page = &page->file;
+	uint64_t *pml4 = page->owner->pml4;
+
+	lock_acquire (&writeback_lock);
+	if (pml4 != NULL && pml4_is_dirty (pml4, page->va)) {
+		pml4_set_dirty (pml4, page->va, false);
+		file_write_at (file_page->file, page->frame->kva,
+				file_page->read_bytes, file_page->ofs);
+		wb_sync_cnt++;
+	}
+	lock_release (&writeback_lock);
+}
+
+static bool
+wb_entry_less (const void *a_, const void *b_) {
+	const struct wb_entry *a = a_;
+	const struct wb_entry *b = b_;
+
+	if (a->file != b->file)
+		return a->file < b->file;
+	return a->ofs < b->ofs;
+}
+
+static int
+wb_entry_compare (const void *a, const void *b) {
+	return wb_entry_less (a, b) ? -1 : wb_entry_less (b, a);
+}
+
+/* Collects up to WB_BATCH_PAGES dirty file pages, copies them into
+ * wb_buffer sorted by file and offset, and writes each run of consecutive
+ * pages with one file_write_at().  Dirty bits are cleared before the copy,
+ * so a write that races with it leaves the page dirty for the next pass.
+ * Returns the number of pages written. */
+static size_t
+writeback_scan (void) {
+	struct frame *frame;
+	size_t cnt = 0, i, run;
+
+	vm_frame_lock_acquire ();
+	for (frame = vm_frame_next (NULL); frame != NULL && cnt < WB_BATCH_PAGES;
+			frame = vm_frame_next (frame)) {
+		struct page *page = frame->page;
+		uint64_t *pml4;
+
+		if (page == NULL || VM_TYPE (page->operations->type) != VM_FILE
+				|| page->file.read_bytes == 0
+				|| (pml4 = page->owner->pml4) == NULL
+				|| !pml4_is_dirty (pml4, page->va))
+			continue;
+		wb_batch[cnt++] = (struct wb_entry) {
+			.file = page->file.file,
+			.ofs = page->file.ofs,
+			.bytes = page->file.read_bytes,
+			.kva = frame->kva,
+			.pml4 = pml4,
+			.va = page->va,
+		};
+	}
+	if (cnt == 0) {
+		vm_frame_lock_release ();
+		return 0;
+	}
+
+	qsort (wb_batch, cnt, sizeof *wb_batch, wb_entry_compare);
+	for (i = 0; i < cnt; i++) {
+		pml4_set_dirty (wb_batch[i].pml4, wb_batch[i].va, false);
+		memcpy (wb_buffer + i * PGSIZE, wb_batch[i].kva, PGSIZE);
+	}
+
+	/* 페이지가 해제되려면 writeback_lock 을 거쳐야 하므로, 이 lock 을 잡은
+	 * 뒤에는 frame lock 을 놓아도 파일이 닫히지 않는다. */
+	lock_acquire (&writeback_lock);
+	vm_frame_lock_release ();
+	for (i = 0; i < cnt; i = run) {
+		size_t bytes = wb_batch[i].bytes;
+
+		/* 같은 파일에서 오프셋이 이어지는 페이지는 한 번에 쓴다. */
+		for (run = i + 1; run < cnt
+				&& wb_batch[run].file == wb_batch[i].file
+				&& wb_batch[run - 1].bytes == PGSIZE
+				&& wb_batch[run].ofs == wb_batch[run - 1].ofs + PGSIZE; run++)
+			bytes += wb_batch[run].bytes;
+		file_write_at (wb_batch[i].file, wb_buffer + i * PGSIZE, bytes,
+				wb_batch[i].ofs);
+		wb_write_cnt++;
+	}
+	wb_page_cnt += cnt;
+	lock_release (&writeback_lock);
+	return cnt;
+}
+
+/* Dirty page writeback daemon. */
+static void
+flushd (void *aux UNUSED) {
+	for (;;) {
+		timer_msleep (WB_INTERVAL_MS);
+		while (writeback_scan () == WB_BATCH_PAGES)
+			continue;
+	}
+}
+
+/* Prints writeback statistics. */
+void
+file_print_stats (void) {
+	printf ("Writeback: %lld pages in %lld writes by flushd, "
+			"%lld pages written synchronously\n",
+			wb_page_cnt, wb_write_cnt, wb_sync_cnt);
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (file_read_at (file_page->file, kva, file_page->read_bytes,
+				file_page->ofs) != (off_t) file_page->read_bytes)
+		return false;
+	memset ((uint8_t *) kva + file_page->read_bytes, 0, file_page->zero_bytes);
+	return true;
 }
 
 /* Swap out the page by writeback contents to the file. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	file_backed_writeback (page);
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	if (page->frame != NULL)
+		file_backed_writeback (page);
+	vm_free_frame (page);
+}
+
+/* 첫 fault 때 파일 내용을 읽어 페이지를 채운다. */
+static bool
+lazy_load_file (struct page *page, void *aux) {
+	bool success = file_backed_swap_in (page, page->frame->kva);
+	free (aux);
+	return success;
 }
 
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct mmap_region *region;
+	off_t file_len;
+	size_t page_cnt, i;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || offset % PGSIZE != 0
+			|| length == 0 || file == NULL)
+		return NULL;
+	if (!is_user_vaddr (addr) || !is_user_vaddr (addr + length - 1)
+			|| addr + length < addr)
+		return NULL;
+
+	page_cnt = DIV_ROUND_UP (length, PGSIZE);
+	for (i = 0; i < page_cnt; i++)
+		if (spt_find_page (spt, addr + i * PGSIZE) != NULL)
+			return NULL;
+
+	region = malloc (sizeof *region);
+	if (region == NULL)
+		return NULL;
+	region->file = file_reopen (file);
+	if (region->file == NULL) {
+		free (region);
+		return NULL;
+	}
+	region->addr = addr;
+	region->page_cnt = page_cnt;
+	region->ra_end = NULL;
+	region->ra_pages = 0;
+	list_push_back (&spt->mmaps, &region->elem);
+
+	file_len = file_length (region->file);
+	for (i = 0; i < page_cnt; i++) {
+		off_t ofs = offset + i * PGSIZE;
+		size_t read_bytes = ofs < file_len ? file_len - ofs : 0;
+		struct lazy_load_arg *aux = malloc (sizeof *aux);
+
+		if (read_bytes > PGSIZE)
+			read_bytes = PGSIZE;
+		if (aux == NULL)
+			goto fail;
+		aux->file = region->file;
+		aux->region = region;
+		aux->ofs = ofs;
+		aux->read_bytes = read_bytes;
+		aux->zero_bytes = PGSIZE - read_bytes;
+		if (!vm_alloc_page_with_initializer (VM_FILE, addr + i * PGSIZE,
+					writable, lazy_load_file, aux)) {
+			free (aux);
+			goto fail;
+		}
+	}
+	return addr;
+
+fail:
+	region->page_cnt = i;
+	do_munmap (addr);
+	return NULL;
+}
+
+/* Returns the mmap region PAGE belongs to, or NULL if PAGE is not part of
+ * a file mapping. */
+struct mmap_region *
+file_page_region (struct page *page) {
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			if (VM_TYPE (page->uninit.type) != VM_FILE)
+				return NULL;
+			return ((struct lazy_load_arg *) page->uninit.aux)->region;
+		case VM_FILE:
+			return page->file.region;
+		default:
+			return NULL;
+	}
+}
+
+/* Removes every page of REGION from SPT and releases the region. Pages that
+ * are still dirty after flushd's last pass are written back by
+ * file_backed_destroy(). */
+static void
+mmap_region_remove (struct supplemental_page_table *spt,
+		struct mmap_region *region) {
+	for (size_t i = 0; i < region->page_cnt; i++) {
+		struct page *page = spt_find_page (spt, region->addr + i * PGSIZE);
+		if (page != NULL)
+			spt_remove_page (spt, page);
+	}
+	list_remove (&region->elem);
+	file_close (region->file);
+	free (region);
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct list_elem *e;
+
+	for (e = list_begin (&spt->mmaps); e != list_end (&spt->mmaps);
+			e = list_next (e)) {
+		struct mmap_region *region = list_entry (e, struct mmap_region, elem);
+		if (region->addr == addr) {
+			mmap_region_remove (spt, region);
+			return;
+		}
+	}
+}
+
+/* 프로세스 종료 시 남아 있는 모든 매핑을 해제한다. */
+void
+do_munmap_all (struct supplemental_page_table *spt) {
+	while (!list_empty (&spt->mmaps))
+		mmap_region_remove (spt, list_entry (list_front (&spt->mmaps),
+					struct mmap_region, elem));
 }
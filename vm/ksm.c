@@ -0,0 +1,320 @@
+/* ksm.c: Kernel samepage merging for anonymous pages.
+ *
+ * ksmd is a low-priority kernel thread that periodically walks part of the
+ * frame table.  An anonymous frame whose contents hash the same on two
+ * consecutive visits is considered stable and is merged with an identical
+ * frame: all-zero frames go to the shared zero frame, and other frames go
+ * to a read-only frame kept in the stable tree.  A later write to a merged
+ * page is handled by vm_handle_wp(), which gives the page a private copy.
+ *
+ * Stable tree entries never change contents, so they are compared by
+ * content.  Candidates seen during one full pass over the frame table are
+ * kept in the unstable tree by their checksum, because their owners may
+ * still write to them; they are compared again right before merging.  The
+ * unstable tree is emptied when a pass wraps around.  Merging runs with
+ * interrupts off, so the owner cannot write between the compare and the
+ * remap.
+ *
+ * Merged frames live in the frame table and can be evicted like shared
+ * text frames, for all of their pages at once. */
+
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+#include "vm/ksm.h"
+
+/* ksmd 가 한 번 검사한 뒤 쉬는 시간 */
+#define KSM_SLEEP_MS 100
+
+size_t ksm_pages_to_scan;
+
+/* 병합된 공유 프레임 (stable tree 의 원소) */
+struct ksm_entry {
+	struct hash_elem elem;
+	struct frame frame;         /* share_cnt 가 매핑한 페이지 수 */
+};
+
+/* stable tree 와 unstable tree. 둘 다 frame lock 으로 보호된다.
+ * unstable tree 에는 이번 한 바퀴 동안 만난 후보 프레임이 들어 있다. */
+static struct hash ksm_tree;
+static struct hash unstable;
+
+/* 통계 */
+static long long merged_cnt;        /* 공유 프레임으로 바꾼 페이지 수 */
+static long long zero_merged_cnt;   /* 그 중 zero frame 으로 바꾼 수 */
+static long long full_scan_cnt;     /* frame table 을 끝까지 훑은 횟수 */
+static long long ksm_ticks;         /* ksmd 가 검사에 쓴 timer tick */
+
+static void ksmd (void *aux);
+
+static uint64_t
+ksm_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct ksm_entry, elem)->frame.checksum;
+}
+
+static bool
+ksm_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct frame *a = &hash_entry (a_, struct ksm_entry, elem)->frame;
+	const struct frame *b = &hash_entry (b_, struct ksm_entry, elem)->frame;
+
+	if (a->checksum != b->checksum)
+		return a->checksum < b->checksum;
+	return memcmp (a->kva, b->kva, PGSIZE) < 0;
+}
+
+static uint64_t
+candidate_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct frame, ksm_elem)->checksum;
+}
+
+static bool
+candidate_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct frame, ksm_elem)->checksum
+		< hash_entry (b, struct frame, ksm_elem)->checksum;
+}
+
+static void
+candidate_clear (struct hash_elem *e, void *aux UNUSED) {
+	hash_entry (e, struct frame, ksm_elem)->ksm_candidate = false;
+}
+
+/* Initializes samepage merging and starts ksmd if it is enabled. */
+void
+ksm_init (void) {
+	hash_init (&ksm_tree, ksm_hash, ksm_less, NULL);
+	hash_init (&unstable, candidate_hash, candidate_less, NULL);
+	if (ksm_pages_to_scan > 0)
+		thread_create ("ksmd", PRI_MIN, ksmd, NULL);
+}
+
+/* Adds a reference to the merged FRAME.  The frame lock must be held. */
+void
+ksm_get_frame (struct frame *frame) {
+	ASSERT (frame->merged && frame->share_cnt > 0);
+	frame->share_cnt++;
+}
+
+/* Drops a reference to the merged FRAME, freeing it with the last one.
+ * The frame lock must be held. */
+void
+ksm_put_frame (struct frame *frame) {
+	struct ksm_entry *entry = (struct ksm_entry *) ((uint8_t *) frame
+			- offsetof (struct ksm_entry, frame));
+
+	ASSERT (frame->merged && frame->share_cnt > 0);
+	if (--frame->share_cnt == 0) {
+		hash_delete (&ksm_tree, &entry->elem);
+		vm_frame_remove (frame);
+		palloc_free_page (frame->kva);
+		free (entry);
+	}
+}
+
+/* Drops the merged FRAME, which the clock has evicted and taken out of the
+ * frame table, from the stable tree.  Its memory is left to the caller.
+ * The frame lock must be held. */
+void
+ksm_forget_frame (struct frame *frame) {
+	struct ksm_entry *entry = (struct ksm_entry *) ((uint8_t *) frame
+			- offsetof (struct ksm_entry, frame));
+
+	ASSERT (frame->merged && frame->share_cnt == 0);
+	hash_delete (&ksm_tree, &entry->elem);
+	free (entry);
+}
+
+/* Removes FRAME, which is leaving the frame table, from the unstable
+ * tree.  The frame lock must be held. */
+void
+ksm_forget_candidate (struct frame *frame) {
+	ASSERT (frame->ksm_candidate);
+	hash_delete (&unstable, &frame->ksm_elem);
+	frame->ksm_candidate = false;
+}
+
+/* Returns true if FRAME is a private anonymous frame that may be merged.
+ * An mlocked page keeps its own frame. */
+static bool
+ksm_mergeable (struct frame *frame) {
+	struct page *page = frame->page;
+
+	return page != NULL && !frame->pinned && frame->thp == NULL
+		&& page->owner->pml4 != NULL && page->frame == frame
+		&& VM_TYPE (page->operations->type) == VM_ANON && !page->mlocked;
+}
+
+/* Returns true if the page at KVA is all zero. */
+static bool
+page_is_zero (const void *kva) {
+	const uint64_t *words = kva;
+	for (size_t i = 0; i < PGSIZE / sizeof *words; i++)
+		if (words[i] != 0)
+			return false;
+	return true;
+}
+
+/* Turns the private frame of CAND, whose contents are stable, into a new
+ * merged frame using SPARE as its stable tree entry. */
+static struct frame *
+ksm_promote (struct frame *cand, struct ksm_entry *spare) {
+	struct page *page = cand->page;
+	struct frame *shared = &spare->frame;
+
+	vm_frame_init (shared, cand->kva);
+	shared->share_cnt = 1;
+	shared->merged = true;
+	shared->checksum = cand->checksum;
+	hash_insert (&ksm_tree, &spare->elem);
+
+	/* 같은 물리 페이지를 읽기 전용으로 다시 매핑하고, frame table 에서는
+	 * private 프레임 구조체 자리에 공유 프레임을 넣는다. */
+	pml4_clear_page (page->owner->pml4, page->va);
+	pml4_set_page (page->owner->pml4, page->va, shared->kva, false);
+	page->frame = shared;
+	list_push_back (&shared->sharers, &page->share_elem);
+	list_insert (&cand->frame_elem, &shared->frame_elem);
+	vm_frame_detach (cand);
+	merged_cnt++;
+	return shared;
+}
+
+/* Examines FRAME once.  SPARE is a preallocated stable tree entry; returns
+ * true if it was consumed.  Runs with the frame lock held and interrupts
+ * off. */
+static bool
+ksm_scan_frame (struct frame *frame, struct ksm_entry *spare) {
+	struct ksm_entry key, *entry;
+	struct frame ckey, *cand;
+	struct hash_elem *e;
+	uint64_t sum;
+
+	/* 한 바퀴 도는 사이 frame table 이 바뀌어 같은 프레임을 다시 만날 수
+	 * 있다. 해시 키인 checksum 을 바꾸기 전에 unstable tree 에서 뺀다. */
+	if (frame->ksm_candidate)
+		ksm_forget_candidate (frame);
+	if (!ksm_mergeable (frame))
+		return false;
+
+	/* 두 번 연속 같은 해시가 나온 프레임만 안정된 것으로 본다. */
+	sum = hash_bytes (frame->kva, PGSIZE);
+	if (sum != frame->checksum) {
+		frame->checksum = sum;
+		return false;
+	}
+
+	if (page_is_zero (frame->kva)) {
+		vm_frame_replace (frame, vm_get_zero_frame ());
+		merged_cnt++;
+		zero_merged_cnt++;
+		return false;
+	}
+
+	/* stable tree 에 같은 내용이 있으면 그 프레임을 공유한다. */
+	key.frame.checksum = sum;
+	key.frame.kva = frame->kva;
+	e = hash_find (&ksm_tree, &key.elem);
+	if (e != NULL) {
+		entry = hash_entry (e, struct ksm_entry, elem);
+		ksm_get_frame (&entry->frame);
+		vm_frame_replace (frame, &entry->frame);
+		merged_cnt++;
+		return false;
+	}
+
+	/* 이번 바퀴에서 같은 해시의 후보를 이미 만났다면 둘을 합친다. 후보는
+	 * 그 뒤에 다른 페이지에 쓰였을 수 있으므로 다시 확인한다. */
+	ckey.checksum = sum;
+	e = hash_find (&unstable, &ckey.ksm_elem);
+	if (e != NULL) {
+		cand = hash_entry (e, struct frame, ksm_elem);
+		if (ksm_mergeable (cand) && !memcmp (cand->kva, frame->kva, PGSIZE)) {
+			struct frame *shared;
+
+			ksm_forget_candidate (cand);
+			shared = ksm_promote (cand, spare);
+			ksm_get_frame (shared);
+			vm_frame_replace (frame, shared);
+			merged_cnt++;
+			return true;
+		}
+		return false;
+	}
+
+	hash_insert (&unstable, &frame->ksm_elem);
+	frame->ksm_candidate = true;
+	return false;
+}
+
+/* Examines up to ksm_pages_to_scan frames, starting at position *POS of the
+ * frame table.  The unstable tree carries over to the next call until the
+ * scan wraps around to the start of the table. */
+static void
+ksm_scan (size_t *pos) {
+	struct ksm_entry *spare = NULL;
+	struct frame *frame, *next;
+	size_t i;
+
+	vm_frame_lock_acquire ();
+	frame = vm_frame_next (NULL);
+	for (i = 0; frame != NULL && i < *pos; i++)
+		frame = vm_frame_next (frame);
+
+	for (i = 0; i < ksm_pages_to_scan; i++) {
+		if (frame == NULL) {
+			/* frame table 끝에 닿으면 후보를 비우고 처음부터 다시 */
+			full_scan_cnt++;
+			hash_clear (&unstable, candidate_clear);
+			*pos = 0;
+			frame = vm_frame_next (NULL);
+			if (frame == NULL)
+				break;
+		}
+		next = vm_frame_next (frame);
+
+		if (spare == NULL)
+			spare = malloc (sizeof *spare);
+		if (spare != NULL) {
+			enum intr_level old_level = intr_disable ();
+			if (ksm_scan_frame (frame, spare))
+				spare = NULL;
+			intr_set_level (old_level);
+		}
+
+		(*pos)++;
+		frame = next;
+	}
+	vm_frame_lock_release ();
+
+	free (spare);
+}
+
+/* Samepage merging daemon. */
+static void
+ksmd (void *aux UNUSED) {
+	size_t pos = 0;
+
+	for (;;) {
+		int64_t start = timer_ticks ();
+		ksm_scan (&pos);
+		ksm_ticks += timer_ticks () - start;
+		timer_msleep (KSM_SLEEP_MS);
+	}
+}
+
+/* Prints samepage merging statistics. */
+void
+ksm_print_stats (void) {
+	printf ("KSM: %lld pages merged (%lld into the zero page), "
+			"%lld full scans, %lld ticks\n",
+			merged_cnt, zero_merged_cnt, full_scan_cnt, ksm_ticks);
+}
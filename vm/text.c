@@ -0,0 +1,214 @@
+/* text.c: Cache of read-only executable pages shared between processes.
+ *
+ * Read-only PT_LOAD segments of the same executable have identical contents
+ * in every process, so their frames are looked up by (inode sector, file
+ * offset) and mapped read-only into each process that runs the binary.
+ * Cached frames live in the frame table, where share_cnt counts the pages
+ * that map them.  A frame is released when the last page that maps it goes
+ * away, or when the clock evicts it for all of its pages at once.  File
+ * reads happen without text_lock held. */
+
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+#include "vm/text.h"
+
+/* 공유되는 실행 파일 페이지 하나 */
+struct text_entry {
+	struct hash_elem elem;      /* text_cache 의 원소 */
+	disk_sector_t inumber;      /* 실행 파일 inode 의 섹터 번호 */
+	off_t ofs;                  /* 파일 내 오프셋 */
+	size_t read_bytes;          /* 파일에서 읽은 바이트 수 */
+	struct frame frame;         /* 공유 프레임. share_cnt 가 참조 수 */
+};
+
+/* text_cache 는 text_lock 으로, 각 프레임의 share_cnt 는 frame lock 으로
+ * 보호된다. */
+static struct hash text_cache;
+static struct lock text_lock;
+
+/* 통계 */
+static long long text_hit_cnt;    /* 이미 캐시에 있던 프레임을 공유한 수 */
+static long long text_miss_cnt;   /* 파일에서 새로 읽어 캐시에 넣은 수 */
+
+static uint64_t
+text_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct text_entry *t = hash_entry (e, struct text_entry, elem);
+	return hash_int (t->inumber) ^ hash_int (t->ofs);
+}
+
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct text_entry *a = hash_entry (a_, struct text_entry, elem);
+	const struct text_entry *b = hash_entry (b_, struct text_entry, elem);
+
+	if (a->inumber != b->inumber)
+		return a->inumber < b->inumber;
+	if (a->ofs != b->ofs)
+		return a->ofs < b->ofs;
+	return a->read_bytes < b->read_bytes;
+}
+
+/* Initializes the shared text cache. */
+void
+vm_text_init (void) {
+	hash_init (&text_cache, text_hash, text_less, NULL);
+	lock_init (&text_lock);
+}
+
+/* Returns the cache entry for the contents described by ARG, or NULL if
+ * they are not cached. */
+static struct text_entry *
+text_lookup (struct lazy_load_arg *arg) {
+	struct text_entry key;
+	struct hash_elem *e;
+
+	key.inumber = inode_get_inumber (file_get_inode (arg->file));
+	key.ofs = arg->ofs;
+	key.read_bytes = arg->read_bytes;
+	lock_acquire (&text_lock);
+	e = hash_find (&text_cache, &key.elem);
+	lock_release (&text_lock);
+	return e != NULL ? hash_entry (e, struct text_entry, elem) : NULL;
+}
+
+/* Returns true if the contents of the unloaded text PAGE are already in the
+ * cache, so that claiming it reads nothing from disk. */
+bool
+text_is_cached (struct page *page) {
+	return text_lookup (page->uninit.aux) != NULL;
+}
+
+/* Reads the contents described by ARG into a new, unpublished cache entry.
+ * Returns NULL if no frame is free; the caller then falls back to a private
+ * frame, which may evict. */
+static struct text_entry *
+text_load (struct lazy_load_arg *arg) {
+	struct text_entry *t = malloc (sizeof *t);
+	void *kva;
+
+	if (t == NULL)
+		return NULL;
+	kva = palloc_get_page (PAL_USER);
+	if (kva == NULL) {
+		free (t);
+		return NULL;
+	}
+	if (file_read_at (arg->file, kva, arg->read_bytes, arg->ofs)
+			!= (off_t) arg->read_bytes) {
+		palloc_free_page (kva);
+		free (t);
+		return NULL;
+	}
+	memset ((uint8_t *) kva + arg->read_bytes, 0, arg->zero_bytes);
+
+	t->inumber = inode_get_inumber (file_get_inode (arg->file));
+	t->ofs = arg->ofs;
+	t->read_bytes = arg->read_bytes;
+	vm_frame_init (&t->frame, kva);
+	return t;
+}
+
+/* Maps the shared frame for PAGE, an unloaded read-only text page, into its
+ * owner's address space.  Returns false if the page must be loaded into a
+ * private frame instead. */
+bool
+text_claim_page (struct page *page) {
+	struct lazy_load_arg *arg = page->uninit.aux;
+	struct text_entry *t, *fresh = NULL;
+	bool success;
+
+	/* 캐시에 없으면 lock 없이 파일에서 먼저 읽는다. 그 사이 다른 프로세스가
+	 * 같은 내용을 넣었으면 그쪽을 쓰고 읽어 온 것은 버린다. */
+	vm_frame_lock_acquire ();
+	t = text_lookup (arg);
+	if (t == NULL) {
+		vm_frame_lock_release ();
+		fresh = text_load (arg);
+		if (fresh == NULL)
+			return false;
+		vm_frame_lock_acquire ();
+		t = text_lookup (arg);
+	}
+	if (t == NULL) {
+		t = fresh;
+		fresh = NULL;
+		lock_acquire (&text_lock);
+		hash_insert (&text_cache, &t->elem);
+		lock_release (&text_lock);
+		vm_frame_add (&t->frame);
+		text_miss_cnt++;
+	} else
+		text_hit_cnt++;
+
+	t->frame.share_cnt++;
+	success = vm_map_shared_frame (page, &t->frame);
+	if (!success)
+		text_put_frame (&t->frame);
+	vm_frame_lock_release ();
+
+	if (fresh != NULL) {
+		palloc_free_page (fresh->frame.kva);
+		free (fresh);
+	}
+	/* lazy_load_segment() 가 호출되지 않으므로 aux 는 여기서 해제한다. */
+	if (success)
+		free (arg);
+	return success;
+}
+
+/* Drops one reference to the shared FRAME, freeing it with the last one.
+ * The frame lock must be held. */
+void
+text_put_frame (struct frame *frame) {
+	struct text_entry *t = (struct text_entry *) ((uint8_t *) frame
+			- offsetof (struct text_entry, frame));
+
+	ASSERT (frame->share_cnt > 0);
+	if (--frame->share_cnt == 0) {
+		lock_acquire (&text_lock);
+		hash_delete (&text_cache, &t->elem);
+		lock_release (&text_lock);
+		vm_frame_remove (frame);
+		palloc_free_page (frame->kva);
+		free (t);
+	}
+}
+
+/* Drops the shared FRAME, which the clock has evicted and taken out of the
+ * frame table, from the cache.  Its memory is left to the caller. */
+void
+text_forget_frame (struct frame *frame) {
+	struct text_entry *t = (struct text_entry *) ((uint8_t *) frame
+			- offsetof (struct text_entry, frame));
+
+	ASSERT (frame->share_cnt == 0);
+	lock_acquire (&text_lock);
+	hash_delete (&text_cache, &t->elem);
+	lock_release (&text_lock);
+	free (t);
+}
+
+/* Adds one reference to the shared FRAME, for a page copied by fork.
+ * The frame lock must be held. */
+void
+text_get_frame (struct frame *frame) {
+	ASSERT (frame->share_cnt > 0);
+	frame->share_cnt++;
+}
+
+/* Prints shared text statistics. */
+void
+text_print_stats (void) {
+	printf ("VM: %lld shared text hits, %lld shared text misses\n",
+			text_hit_cnt, text_miss_cnt);
+}
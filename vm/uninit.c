@@ -8,6 +8,9 @@
  * function.
  * */
 
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/uninit.h"
 
@@ -51,9 +54,19 @@ uninit_initialize (struct page *page, void *kva) {
 	vm_initializer *init = uninit->init;
 	void *aux = uninit->aux;
 
-	/* TODO: You may need to fix this function. */
-	return uninit->page_initializer (page, uninit->type, kva) &&
-		(init ? init (page, aux) : true);
+	enum vm_type type = uninit->type;
+
+	if (!uninit->page_initializer (page, type, kva))
+		return false;
+
+	/* 초기화 함수가 없는 익명 페이지는 0 으로 채워진 상태로 시작한다.
+	 * palloc 에서 PAL_ZERO 를 쓰지 않으므로 여기서 직접 채운다. */
+	if (init == NULL) {
+		if (VM_TYPE (type) == VM_ANON)
+			memset (kva, 0, PGSIZE);
+		return true;
+	}
+	return init (page, aux);
 }
 
 /* Free the resources hold by uninit_page. Although most of pages are transmuted
@@ -62,7 +75,8 @@ uninit_initialize (struct page *page, void *kva) {
  * PAGE will be freed by the caller. */
 static void
 uninit_destroy (struct page *page) {
-	struct uninit_page *uninit UNUSED = &page->uninit;
-	/* TODO: Fill this function.
-	 * TODO: If you don't have anything to do, just return. */
+	struct uninit_page *uninit = &page->uninit;
+
+	/* 한 번도 로드되지 않은 페이지의 aux 는 여기서 해제한다. */
+	free (uninit->aux);
 }
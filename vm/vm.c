@@ -1,8 +1,105 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <bitmap.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#include "filesys/inode.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/ksm.h"
+#include "vm/text.h"
+
+/* 물리 프레임 테이블. 유저 풀에서 할당된 모든 프레임을 clock 순서로 관리 */
+static struct list frame_table;
+static struct lock frame_lock;
+static struct list_elem *clock_hand;
+
+/* 모든 익명 페이지가 처음 읽힐 때 공유하는 읽기 전용 zero frame.
+ * frame table 에 들어가지 않으므로 evict 되거나 해제되지 않는다. */
+static struct frame zero_frame;
+
+/* zero frame 통계 */
+static long long zero_map_cnt;     /* zero frame 으로 처리한 읽기 fault 수 */
+static long long zero_break_cnt;   /* zero frame 에서 private 프레임으로 분리된 수 */
+
+/* 파일에서 읽어 오는 페이지에 읽기 fault 가 나면, 같은 정렬 구간 안의
+ * 이웃 페이지도 미리 읽어 매핑한다 (fault-around). */
+#define FAULT_AROUND_PAGES 16
+
+/* fault-around 통계 */
+static long long fault_around_cnt;   /* fault-around 로 미리 매핑한 페이지 수 */
+static long long fault_avoided_cnt;  /* 그 중 실제로 접근되어 fault 를 아낀 수 */
+
+/* mmap 된 파일을 순차로 읽으면 fault-around 구간 뒤쪽을 RA_MIN_PAGES 에서
+ * RA_MAX_PAGES 까지 두 배씩 늘려 가며 readaheadd 에게 미리 읽힌다.
+ * 창을 흔히 쓰는 64 페이지까지 키우지 않는 것은 버퍼 캐시가 64 섹터
+ * (8 페이지) 뿐이고 readaheadd 의 큐도 64 섹터이기 때문이다.  그보다 큰
+ * 창은 fault 가 오기 전에 자기가 미리 읽은 섹터를 스스로 밀어내거나 큐에서
+ * 버려지므로 디스크 읽기만 늘어난다.  그래서 캐시의 절반 (4 페이지) 에서
+ * 멈춘다.  캐시를 키우면 이 상한도 함께 올린다. */
+#define RA_MIN_PAGES 1
+#define RA_MAX_PAGES 4
+
+/* readahead 통계 */
+static long long ra_window_cnt;      /* readahead 를 시작한 fault 수 */
+static long long ra_page_cnt;        /* readaheadd 에게 맡긴 페이지 수 */
+
+/* 한 프로세스가 mlock 으로 고정할 수 있는 최대 페이지 수 (1 MB).
+ * 모든 프레임이 고정되면 eviction 할 곳이 없으므로 상한을 둔다. */
+#define MLOCK_MAX_PAGES 256
+
+/* 프로세스별 상한만으로는 여러 프로세스가 함께 user pool 을 모두 고정할 수
+ * 있으므로, 모든 프로세스를 합쳐 user pool 의 1/MLOCK_TOTAL_DIV 까지만
+ * 고정하게 한다.  mlock_total 은 frame lock 으로 보호한다. */
+#define MLOCK_TOTAL_DIV 2
+static size_t mlock_total;           /* 모든 프로세스가 고정한 페이지 수 */
+static size_t mlock_total_max;       /* mlock_total 의 상한 */
+
+/* 2 MB 정렬 구간이 모두 아직 쓰이지 않은 익명 페이지라면 fault 한 번에
+ * 구간 전체를 large page 하나로 매핑한다 (transparent huge page).
+ * 각 4 kB 페이지는 여전히 자신의 struct page 와 struct frame 을 가지며,
+ * 개별로 evict 하거나 해제해야 할 때 4 kB 매핑으로 쪼갠다. */
+#define THP_PAGES (LARGE_PGSIZE / PGSIZE)
+
+struct thp {
+	struct frame *head;   /* 첫 프레임. 나머지는 frame table 에서 바로 뒤에 이어진다 */
+	uint64_t *pt;         /* 쪼갤 때 쓸 페이지 테이블. 쪼개기가 실패하지 않도록 미리 받아 둔다 */
+};
+
+/* wssd 는 WSS_INTERVAL_MS 마다 frame table 을 훑으며 accessed bit 를 표본으로
+ * 모아 프로세스별 working set 크기를 추정한다. 지운 accessed bit 는
+ * page->referenced 에 옮겨 두어 clock 이 그대로 참고할 수 있게 한다. */
+#define WSS_INTERVAL_MS 1000
+
+bool vm_acct_print;
+size_t vm_stack_limit = 1 << 20;
+size_t vm_rss_limit;
+size_t vm_swap_limit;
+
+/* OOM killer 가 고른 프로세스에서 프레임을 되찾지 못했을 때
+ * 종료되기를 기다리는 간격과 횟수 */
+#define OOM_WAIT_MS 10
+#define OOM_MAX_WAITS 100
+
+static long long oom_kill_cnt;      /* OOM killer 가 종료시킨 프로세스 수 */
+static unsigned wss_gen;            /* 마지막 표본 번호 */
+
+static void wssd (void *aux);
+
+/* huge page 통계 */
+static long long thp_alloc_cnt;      /* 할당한 huge page 수 */
+static long long thp_split_cnt;      /* 4 kB 매핑으로 쪼갠 수 */
+static long long thp_fallback_cnt;   /* 정렬된 2 MB 블록이 없어 4 kB 로 처리한 수 */
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -15,7 +112,35 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	list_init (&frame_table);
+	lock_init (&frame_lock);
+	clock_hand = NULL;
+	mlock_total_max = palloc_user_page_cnt () / MLOCK_TOTAL_DIV;
+	vm_text_init ();
+
+	vm_frame_init (&zero_frame, palloc_get_page (PAL_ASSERT | PAL_ZERO));
+	zero_frame.pinned = true;
+
+	ksm_init ();
+	thread_create ("wssd", PRI_MIN, wssd, NULL);
+}
+
+/* Prints VM statistics. */
+void
+vm_print_stats (void) {
+	printf ("VM: %lld zero-page faults, %lld zero-page breaks\n",
+			zero_map_cnt, zero_break_cnt);
+	printf ("VM: %lld fault-around pages, %lld faults avoided\n",
+			fault_around_cnt, fault_avoided_cnt);
+	printf ("VM: %lld huge pages, %lld splits, %lld fallbacks\n",
+			thp_alloc_cnt, thp_split_cnt, thp_fallback_cnt);
+	printf ("VM: %lld readahead windows, %lld readahead pages\n",
+			ra_window_cnt, ra_page_cnt);
+	printf ("VM: %lld processes killed for lack of memory\n", oom_kill_cnt);
+	text_print_stats ();
+	ksm_print_stats ();
+	anon_print_stats ();
+	file_print_stats ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -33,9 +158,18 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (struct thread *owner);
 static bool vm_do_claim_page (struct page *page);
-static struct frame *vm_evict_frame (void);
+static struct frame *vm_evict_frame (struct thread *owner);
+static struct frame *vm_get_free_frame (void);
+static bool vm_map_zero_page (struct page *page);
+static bool vm_claim_with_frame (struct page *page, struct frame *frame);
+static void vm_check_prefault (struct page *page);
+static void vm_put_shared_frame (struct frame *frame);
+static void vm_readahead (struct page *page, struct mmap_region *region,
+		uint8_t *start);
+static void vm_thp_split (struct frame *frame);
+static struct frame *vm_thp_tail (struct thp *thp);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -50,11 +184,32 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page = malloc (sizeof *page);
+		if (page == NULL)
+			goto err;
 
-		/* TODO: Insert the page into the spt. */
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				free (page);
+				goto err;
+		}
+
+		uninit_new (page, pg_round_down (upage), init, type, aux, initializer);
+		page->owner = thread_current ();
+		page->writable = writable;
+
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
@@ -62,82 +217,1287 @@ err:
 
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page key;
+	struct hash_elem *e;
 
-	return page;
+	key.va = pg_round_down (va);
+	e = hash_find (&spt->pages, &key.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
+}
+
+/* PAGE 의 mlock 을 풀고 고정 페이지 수에서 뺀다. */
+static void
+vm_unlock_page (struct page *page) {
+	if (!page->mlocked)
+		return;
+	lock_acquire (&frame_lock);
+	page->mlocked = false;
+	page->owner->vm_acct.locked--;
+	mlock_total--;
+	lock_release (&frame_lock);
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
-
-	return succ;
+spt_insert_page (struct supplemental_page_table *spt,
+		struct page *page) {
+	return hash_insert (&spt->pages, &page->spt_elem) == NULL;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	hash_delete (&spt->pages, &page->spt_elem);
+	vm_unlock_page (page);
 	vm_dealloc_page (page);
-	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Returns true if PAGE may not go to swap because its owner has reached the
+ * swap limit. */
+static bool
+vm_swap_limited (struct page *page) {
+	return vm_swap_limit > 0 && page->owner->vm_acct.swap >= vm_swap_limit
+		&& VM_TYPE (page->operations->type) == VM_ANON;
+}
+
+/* Returns true if the shared FRAME may be evicted: every page that maps it
+ * may go to swap, and none of them was accessed since the clock last came
+ * by.  Accessed bits found set are cleared, giving the frame another
+ * round. */
+static bool
+vm_shared_is_victim (struct frame *frame) {
+	bool accessed = false;
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->sharers); e != list_end (&frame->sharers);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, share_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4 == NULL || page->mlocked || vm_swap_limited (page))
+			return false;
+		vm_check_prefault (page);
+		if (pml4_is_accessed (pml4, page->va)) {
+			pml4_set_accessed (pml4, page->va, false);
+			accessed = true;
+		}
+	}
+	return !accessed;
+}
+
+/* Get the struct frame, that will be evicted.  If OWNER is not NULL, only
+ * OWNER's frames are considered. */
 static struct frame *
-vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+vm_get_victim (struct thread *owner) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
 
-	return victim;
+	/* clock 알고리즘: accessed bit 가 켜진 프레임은 bit 를 지우고 한 바퀴
+	 * 기회를 더 준다. 두 바퀴를 돌아도 없으면 모두 pin 된 상태이다. */
+	size_t cnt = list_size (&frame_table) * 2;
+	while (cnt-- > 0) {
+		if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+
+		struct frame *frame = list_entry (clock_hand, struct frame, frame_elem);
+		clock_hand = list_next (clock_hand);
+
+		/* 공유 프레임은 매핑한 모든 페이지를 함께 본다. */
+		if (frame->share_cnt > 0) {
+			if (owner == NULL && !frame->pinned && vm_shared_is_victim (frame))
+				return frame;
+			continue;
+		}
+
+		struct page *page = frame->page;
+		/* pml4 가 없는 페이지는 주인 프로세스가 해제하는 중이다. */
+		if (page == NULL || frame->pinned || page->mlocked
+				|| page->owner->pml4 == NULL || vm_swap_limited (page)
+				|| (owner != NULL && page->owner != owner))
+			continue;
+
+		uint64_t *pml4 = page->owner->pml4;
+
+		/* huge page 는 512 페이지가 PDE 의 accessed bit 하나를 같이 쓴다.
+		 * 최근에 쓰였으면 통째로 건너뛰고, 희생자로 고른 경우에만 나눈다. */
+		if (frame->thp != NULL) {
+			if (pml4_is_accessed (pml4, page->va)) {
+				pml4_set_accessed (pml4, page->va, false);
+				clock_hand = list_next (&vm_thp_tail (frame->thp)->frame_elem);
+				continue;
+			}
+			vm_thp_split (frame);
+		}
+
+		vm_check_prefault (page);
+		if (pml4_is_accessed (pml4, page->va) || page->referenced) {
+			pml4_set_accessed (pml4, page->va, false);
+			page->referenced = false;
+		} else
+			return frame;
+	}
+	return NULL;
+}
+
+/* Swaps out the shared frame SHARED once for all the pages that map it.
+ * Its contents go to a single swap slot that every page refers to, and its
+ * memory is returned as a new private frame that takes its place in the
+ * frame table.  Returns NULL on error. */
+static struct frame *
+vm_evict_shared (struct frame *shared) {
+	struct frame *frame = malloc (sizeof *frame);
+	struct list_elem *e;
+	size_t slot;
+
+	if (frame == NULL)
+		return NULL;
+
+	/* vm_evict_frame() 과 마찬가지로 매핑을 먼저 지운다. */
+	for (e = list_begin (&shared->sharers); e != list_end (&shared->sharers);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, share_elem);
+		pml4_clear_page (page->owner->pml4, page->va);
+	}
+	slot = anon_write_slot (shared->kva, shared->share_cnt);
+	if (slot == BITMAP_ERROR) {
+		for (e = list_begin (&shared->sharers);
+				e != list_end (&shared->sharers); e = list_next (e)) {
+			struct page *page = list_entry (e, struct page, share_elem);
+			pml4_set_page (page->owner->pml4, page->va, shared->kva, false);
+		}
+		free (frame);
+		return NULL;
+	}
+
+	while (!list_empty (&shared->sharers)) {
+		struct page *page = list_entry (list_pop_front (&shared->sharers),
+				struct page, share_elem);
+		page->frame = NULL;
+		page->anon.swap_slot = slot;
+		page->owner->vm_acct.rss--;
+		page->owner->vm_acct.swap++;
+	}
+	shared->share_cnt = 0;
+
+	vm_frame_init (frame, shared->kva);
+	list_insert (&shared->frame_elem, &frame->frame_elem);
+	vm_frame_remove (shared);
+	if (shared->merged)
+		ksm_forget_frame (shared);
+	else
+		text_forget_frame (shared);
+	return frame;
 }
 
 /* Evict one page and return the corresponding frame.
  * Return NULL on error.*/
 static struct frame *
-vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+vm_evict_frame (struct thread *owner) {
+	struct frame *victim = vm_get_victim (owner);
+	if (victim == NULL)
+		return NULL;
+	if (victim->share_cnt > 0)
+		return vm_evict_shared (victim);
 
-	return NULL;
+	/* 내용을 내보내는 동안 주인이 쓰지 못하도록 먼저 매핑을 지운다.
+	 * dirty bit 는 PTE 에 그대로 남아 swap_out 이 읽을 수 있다. */
+	struct page *page = victim->page;
+	uint64_t *pml4 = page->owner->pml4;
+	pml4_clear_page (pml4, page->va);
+	if (!swap_out (page)) {
+		bool dirty = pml4_is_dirty (pml4, page->va);
+		pml4_set_page (pml4, page->va, victim->kva, page->writable);
+		pml4_set_dirty (pml4, page->va, dirty);
+		return NULL;
+	}
+
+	page->frame = NULL;
+	page->owner->vm_acct.rss--;
+	victim->page = NULL;
+	return victim;
+}
+
+/* Takes back the frames of VICTIM, which the OOM killer picked, without
+ * waiting for it to exit.  File pages are written back, anonymous contents
+ * are dropped, and pages that share a frame drop their reference to it, so
+ * that the next access by VICTIM faults and kills it even if VICTIM is
+ * blocked in the kernel now.  Returns the number of frames freed.  The
+ * frame lock must be held. */
+static size_t
+vm_oom_reclaim (struct thread *victim) {
+	struct frame *frame, *next;
+	size_t cnt = 0;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	if (victim->pml4 == NULL)
+		return 0;
+
+	for (frame = vm_frame_next (NULL); frame != NULL; frame = next) {
+		struct page *page = frame->page;
+		void *kva = frame->kva;
+
+		next = vm_frame_next (frame);
+		if (frame->share_cnt > 0) {
+			struct list_elem *e = list_begin (&frame->sharers);
+			bool gone = false;
+
+			/* 마지막 참조를 놓으면 프레임이 해제되므로 sharers 를 더 보지
+			 * 않는다. */
+			if (frame->pinned)
+				continue;
+			while (!gone && e != list_end (&frame->sharers)) {
+				page = list_entry (e, struct page, share_elem);
+				e = list_next (e);
+				if (page->owner != victim)
+					continue;
+				pml4_clear_page (victim->pml4, page->va);
+				list_remove (&page->share_elem);
+				page->frame = NULL;
+				victim->vm_acct.rss--;
+				gone = frame->share_cnt == 1;
+				vm_put_shared_frame (frame);
+			}
+			if (gone)
+				cnt++;
+			continue;
+		}
+		if (page == NULL || page->owner != victim || frame->pinned)
+			continue;
+		if (frame->thp != NULL)
+			vm_thp_split (frame);
+
+		pml4_clear_page (victim->pml4, page->va);
+		if (VM_TYPE (page->operations->type) == VM_FILE)
+			swap_out (page);
+		page->frame = NULL;
+		victim->vm_acct.rss--;
+		vm_frame_detach (frame);
+		palloc_free_page (kva);
+		cnt++;
+	}
+	return cnt;
+}
+
+/* Picks the process with the most resident plus swapped pages, marks it to
+ * be killed and reclaims its frames.  Returns false if the current process
+ * was picked, or if nothing can be freed; otherwise returns true to let the
+ * caller retry, after waiting a moment if no frame could be reclaimed. */
+static bool
+vm_oom (int waits) {
+	struct thread *cur = thread_current ();
+	struct thread *victim = NULL, *pending = NULL;
+	size_t victim_score = 0, freed = 0;
+	struct frame *frame;
+
+	if (cur->vm_acct.oom_killed || waits >= OOM_MAX_WAITS)
+		return false;
+
+	/* 프레임을 가진 프로세스만 후보가 된다. 모든 스레드 목록은 없지만
+	 * 점수가 높은 프로세스는 반드시 frame table 에 프레임이 있다. */
+	lock_acquire (&frame_lock);
+	for (frame = vm_frame_next (NULL); frame != NULL;
+			frame = vm_frame_next (frame)) {
+		struct thread *t = frame->page != NULL ? frame->page->owner : NULL;
+		size_t score;
+
+		if (t == NULL || t->pml4 == NULL)
+			continue;
+		if (t->vm_acct.oom_killed) {
+			pending = t;
+			continue;
+		}
+		score = t->vm_acct.rss + t->vm_acct.swap;
+		if (score > victim_score) {
+			victim = t;
+			victim_score = score;
+		}
+	}
+	/* 이미 고른 프로세스가 아직 프레임을 가지고 있으면 새로 고르지 않는다. */
+	if (pending == NULL && victim != NULL) {
+		victim->vm_acct.oom_killed = true;
+		oom_kill_cnt++;
+		printf ("Out of memory: killing %s (%zu pages)\n", victim->name,
+				victim_score);
+		pending = victim;
+	}
+	if (pending != NULL && pending != cur)
+		freed = vm_oom_reclaim (pending);
+	lock_release (&frame_lock);
+
+	if (pending == NULL || cur->vm_acct.oom_killed)
+		return false;
+	if (freed == 0)
+		timer_msleep (OOM_WAIT_MS);
+	return true;
+}
+
+/* Terminates the current process if the OOM killer picked it.  Must be
+ * called from a context that holds no locks, such as the entry of a page
+ * fault on user memory or of a system call. */
+void
+vm_oom_check (void) {
+	struct thread *t = thread_current ();
+
+	if (t->vm_acct.oom_killed) {
+		printf ("%s: exit(%d)\n", t->name, -1);
+		thread_exit ();
+	}
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * and return it.  A process over the RSS limit evicts one of its own pages
+ * instead.  If nothing can be evicted, the OOM killer frees memory by
+ * terminating a process; NULL is returned if the current process is the one
+ * that has to go. */
 static struct frame *
 vm_get_frame (void) {
+	struct thread *t = thread_current ();
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	int waits = 0;
+
+	if (vm_rss_limit > 0 && t->vm_acct.rss >= vm_rss_limit) {
+		lock_acquire (&frame_lock);
+		frame = vm_evict_frame (t);
+		lock_release (&frame_lock);
+	}
+
+	while (frame == NULL) {
+		frame = vm_get_free_frame ();
+		if (frame != NULL)
+			break;
+
+		lock_acquire (&frame_lock);
+		frame = vm_evict_frame (NULL);
+		lock_release (&frame_lock);
+		if (frame == NULL && !vm_oom (waits++))
+			return NULL;
+	}
 
-	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
-/* Growing the stack. */
+/* Obtains a frame from the user pool without evicting anything.
+ * Returns NULL if the pool is exhausted. */
+static struct frame *
+vm_get_free_frame (void) {
+	void *kva = palloc_get_page (PAL_USER);
+	if (kva == NULL)
+		return NULL;
+
+	struct frame *frame = malloc (sizeof *frame);
+	if (frame == NULL) {
+		palloc_free_page (kva);
+		return NULL;
+	}
+	vm_frame_init (frame, kva);
+
+	lock_acquire (&frame_lock);
+	vm_frame_add (frame);
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Initializes FRAME as an unused private frame for the user page at KVA. */
+void
+vm_frame_init (struct frame *frame, void *kva) {
+	frame->kva = kva;
+	frame->page = NULL;
+	frame->pinned = false;
+	frame->share_cnt = 0;
+	list_init (&frame->sharers);
+	frame->merged = false;
+	frame->checksum = 0;
+	frame->ksm_candidate = false;
+	frame->thp = NULL;
+}
+
+/* Adds FRAME to the frame table.  The frame lock must be held. */
+void
+vm_frame_add (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	list_push_back (&frame_table, &frame->frame_elem);
+}
+
+/* Removes FRAME from the frame table, keeping the clock hand valid.  The
+ * frame lock must be held. */
+void
+vm_frame_remove (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	if (clock_hand == &frame->frame_elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&frame->frame_elem);
+	if (frame->ksm_candidate)
+		ksm_forget_candidate (frame);
+}
+
+/* Adds a reference to the shared FRAME. */
+static void
+vm_get_shared_frame (struct frame *frame) {
+	if (frame->merged)
+		ksm_get_frame (frame);
+	else
+		text_get_frame (frame);
+}
+
+/* Drops a reference to the shared FRAME. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+vm_put_shared_frame (struct frame *frame) {
+	if (frame->merged)
+		ksm_put_frame (frame);
+	else
+		text_put_frame (frame);
+}
+
+/* Removes the private FRAME from the frame table and frees the frame
+ * structure.  Its kva is left to the caller.  The frame lock must be held. */
+void
+vm_frame_detach (struct frame *frame) {
+	ASSERT (frame->share_cnt == 0);
+
+	vm_frame_remove (frame);
+	free (frame);
+}
+
+/* Unmaps PAGE and returns its frame to the user pool. Pages that share a
+ * frame only drop their reference to it. */
+void
+vm_free_frame (struct page *page) {
+	struct frame *frame;
+
+	/* ksmd 가 프레임을 바꿔치기하는 중일 수 있으므로 frame lock 을 잡은 뒤에
+	 * page->frame 을 읽는다. */
+	lock_acquire (&frame_lock);
+	frame = page->frame;
+	if (frame == NULL) {
+		lock_release (&frame_lock);
+		return;
+	}
+	if (frame->thp != NULL)
+		vm_thp_split (frame);
+
+	if (page->owner->pml4 != NULL) {
+		vm_check_prefault (page);
+		pml4_clear_page (page->owner->pml4, page->va);
+	}
+	page->frame = NULL;
+	page->owner->vm_acct.rss--;
+	if (frame == &zero_frame) {
+		lock_release (&frame_lock);
+		return;
+	}
+	if (frame->share_cnt > 0) {
+		list_remove (&page->share_elem);
+		vm_put_shared_frame (frame);
+		lock_release (&frame_lock);
+		return;
+	}
+
+	void *kva = frame->kva;
+	vm_frame_detach (frame);
+	lock_release (&frame_lock);
+	palloc_free_page (kva);
+}
+
+/* Acquires the frame table lock. */
+void
+vm_frame_lock_acquire (void) {
+	lock_acquire (&frame_lock);
+}
+
+/* Releases the frame table lock. */
+void
+vm_frame_lock_release (void) {
+	lock_release (&frame_lock);
+}
+
+/* Returns the frame after FRAME in the frame table, the first frame if FRAME
+ * is NULL, or NULL at the end of the table.  The frame lock must be held. */
+struct frame *
+vm_frame_next (struct frame *frame) {
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	e = frame == NULL ? list_begin (&frame_table)
+		: list_next (&frame->frame_elem);
+	return e != list_end (&frame_table)
+		? list_entry (e, struct frame, frame_elem) : NULL;
+}
+
+/* Returns the shared zero frame. */
+struct frame *
+vm_get_zero_frame (void) {
+	return &zero_frame;
+}
+
+/* Maps the shared, read-only SHARED in place of the private FRAME, whose page
+ * must hold the same contents, and frees FRAME.  The caller has already
+ * taken a reference to SHARED and holds the frame lock with interrupts off,
+ * so the owner cannot write to the page in between. */
+void
+vm_frame_replace (struct frame *frame, struct frame *shared) {
+	struct page *page = frame->page;
+	void *kva = frame->kva;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	pml4_clear_page (page->owner->pml4, page->va);
+	pml4_set_page (page->owner->pml4, page->va, shared->kva, false);
+	page->frame = shared;
+	if (shared != &zero_frame)
+		list_push_back (&shared->sharers, &page->share_elem);
+	vm_frame_detach (frame);
+	palloc_free_page (kva);
+}
+
+/* Grows the stack of the current process down to ADDR.  The whole gap
+ * between ADDR and the current bottom of the stack is added at once, and
+ * every gap page below the old bottom other than ADDR's own is claimed
+ * right away, so a large stack frame costs one growth fault rather than
+ * one per page.  The caller brings in ADDR's page as for any other fault.
+ * Returns false if ADDR is not below the stack or out of memory. */
+static bool
+vm_stack_growth (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *va = pg_round_down (addr);
+	uint8_t *p;
+
+	if (va >= (uint8_t *) spt->stack_bottom)
+		return false;
+	for (p = (uint8_t *) spt->stack_bottom - PGSIZE; p >= va; p -= PGSIZE)
+		if (spt_find_page (spt, p) == NULL
+				&& !vm_alloc_page (VM_ANON | VM_STACK, p, true))
+			return false;
+
+	/* 채우지 못한 페이지는 lazy 로 남아 나중에 fault 로 채워진다. */
+	for (p = va + PGSIZE; p < (uint8_t *) spt->stack_bottom; p += PGSIZE) {
+		struct page *page = spt_find_page (spt, p);
+		if (page->frame == NULL && !vm_do_claim_page (page))
+			break;
+	}
+	spt->stack_bottom = va;
+	return true;
+}
+
+/* Returns true if a fault at ADDR is a push just below the stack, within
+ * the stack size limit.  A fault taken in the kernel uses the user rsp saved
+ * at system call entry. */
+static bool
+vm_is_stack_access (struct intr_frame *f, void *addr, bool user) {
+	uintptr_t rsp = user ? f->rsp : thread_current ()->user_rsp;
+
+	return (uint8_t *) addr < (uint8_t *) USER_STACK
+		&& (uint8_t *) addr >= (uint8_t *) USER_STACK - vm_stack_limit
+		&& (uintptr_t) addr >= rsp - 8;
 }
 
 /* Handle the fault on write_protected page */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	struct frame *old = page->frame;
+
+	if (old == NULL || (old != &zero_frame && !old->merged))
+		return false;
+
+	/* 공유 프레임을 읽기만 하던 페이지에 처음 쓰기가 발생함.
+	 * 이 시점에 비로소 private 프레임을 받아 내용을 채운다. */
+	struct frame *frame = vm_get_frame ();
+	if (frame == NULL)
+		return false;
+
+	/* 공유 프레임의 sharers 는 frame lock 으로 보호되므로 그 아래에서
+	 * 복사하고 바꾼다. 새 프레임을 받는 동안 병합된 프레임이 evict
+	 * 되었다면 프레임을 돌려주고 not-present fault 로 다시 읽게 한다. */
+	lock_acquire (&frame_lock);
+	if (page->frame != old) {
+		void *kva = frame->kva;
+		vm_frame_detach (frame);
+		lock_release (&frame_lock);
+		palloc_free_page (kva);
+		return true;
+	}
+	if (old == &zero_frame)
+		memset (frame->kva, 0, PGSIZE);
+	else
+		memcpy (frame->kva, old->kva, PGSIZE);
+	pml4_clear_page (page->owner->pml4, page->va);
+	page->frame = frame;
+	if (old != &zero_frame) {
+		list_remove (&page->share_elem);
+		vm_put_shared_frame (old);
+	}
+	lock_release (&frame_lock);
+
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva, true)) {
+		vm_free_frame (page);
+		return false;
+	}
+	frame->page = page;
+	if (old == &zero_frame)
+		zero_break_cnt++;
+	return true;
+}
+
+/* Returns true if PAGE is an untouched anonymous page whose contents are
+ * all zero, so that a read fault can be served by the zero frame. */
+static bool
+vm_is_zero_fill (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->uninit.init == NULL;
+}
+
+/* Transmutes the uninit PAGE and maps the shared FRAME, which the caller has
+ * already referenced, read-only at it.  On failure PAGE is left uninit.
+ * The frame lock must be held unless FRAME is the zero frame. */
+bool
+vm_map_shared_frame (struct page *page, struct frame *frame) {
+	const struct page_operations *ops = page->operations;
+	struct uninit_page uninit = page->uninit;
+
+	ASSERT (frame == &zero_frame || lock_held_by_current_thread (&frame_lock));
+
+	if (!uninit.page_initializer (page, uninit.type, frame->kva))
+		goto fail;
+
+	page->frame = frame;
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva, false)) {
+		page->frame = NULL;
+		goto fail;
+	}
+	if (frame != &zero_frame)
+		list_push_back (&frame->sharers, &page->share_elem);
+	page->owner->vm_acct.rss++;
+	return true;
+
+fail:
+	page->operations = ops;
+	page->uninit = uninit;
+	return false;
+}
+
+/* Maps the shared zero frame read-only at PAGE. PAGE is transmuted into an
+ * anonymous page without touching the frame's contents. */
+static bool
+vm_map_zero_page (struct page *page) {
+	if (!vm_map_shared_frame (page, &zero_frame))
+		return false;
+	zero_map_cnt++;
+	return true;
+}
+
+/* Returns true if PAGE has not been loaded yet and will be filled from a
+ * file, either an executable segment or an mmapped file. */
+static bool
+vm_is_lazy_file (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_UNINIT
+		&& page->uninit.init != NULL;
+}
+
+/* Returns true if PAGE is an unloaded read-only page of an executable's
+ * text, which can be served from the shared text cache. */
+static bool
+vm_is_shared_text (struct page *page) {
+	return vm_is_lazy_file (page) && (page->uninit.type & VM_TEXT);
+}
+
+/* Maps the lazily loaded neighbours of PAGE inside its FAULT_AROUND_PAGES
+ * aligned window, as long as free frames are available.  Nothing is evicted
+ * for a speculative page, and the fault does not wait for the disk for one:
+ * only neighbours whose contents are already in the buffer cache are
+ * mapped, and the rest are handed to readaheadd, so that a later fault on
+ * them finds them there.  A page advised MADV_SEQUENTIAL reads ahead of
+ * itself instead.  Returns the end of the window. */
+static uint8_t *
+vm_fault_around (struct supplemental_page_table *spt, struct page *page) {
+	uint8_t *start = (uint8_t *) ((uint64_t) page->va
+			& ~((uint64_t) FAULT_AROUND_PAGES * PGSIZE - 1));
+	int cnt = FAULT_AROUND_PAGES;
+
+	/* MADV_SEQUENTIAL 구간은 뒤쪽 페이지만 두 배 길이로 미리 읽는다. */
+	if (page->advice == MADV_SEQUENTIAL) {
+		start = page->va;
+		cnt = FAULT_AROUND_PAGES * 2;
+	}
+
+	for (int i = 0; i < cnt; i++) {
+		uint8_t *va = start + i * PGSIZE;
+		struct lazy_load_arg *arg;
+		struct inode *inode;
+		struct page *next;
+		struct frame *frame;
+
+		if (va == page->va || !is_user_vaddr (va))
+			continue;
+		next = spt_find_page (spt, va);
+		if (next == NULL || !vm_is_lazy_file (next))
+			continue;
+
+		/* 버퍼 캐시에 없는 이웃은 읽기를 기다리지 않고 readaheadd 에게
+		 * 맡기기만 한다. */
+		arg = next->uninit.aux;
+		inode = file_get_inode (arg->file);
+		if (!inode_is_cached (inode, arg->ofs, arg->read_bytes)) {
+			inode_readahead (inode, arg->ofs, arg->read_bytes);
+			ra_page_cnt++;
+			continue;
+		}
+
+		if (vm_is_shared_text (next) && text_claim_page (next)) {
+			next->prefaulted = true;
+			fault_around_cnt++;
+			continue;
+		}
+
+		frame = vm_get_free_frame ();
+		if (frame == NULL)
+			break;
+		if (!vm_claim_with_frame (next, frame))
+			break;
+
+		/* 미리 매핑한 페이지는 accessed bit 가 꺼져 있으므로 clock 이
+		 * 먼저 내보낼 후보가 된다. */
+		next->prefaulted = true;
+		fault_around_cnt++;
+	}
+	return start + cnt * PGSIZE;
+}
+
+/* Reads ahead of a fault on PAGE of the mmap REGION, whose fault-around
+ * window ends at START.  A fault at the end of the previous window, or at
+ * the start of the mapping, counts as sequential and doubles the window up
+ * to RA_MAX_PAGES; any other fault resets it.  The pages from START on are
+ * handed to readaheadd as a single request and loaded into the buffer
+ * cache in the background, so that the next fault-around finds them there
+ * instead of waiting for the disk. */
+static void
+vm_readahead (struct page *page, struct mmap_region *region, uint8_t *start) {
+	uint8_t *end = (uint8_t *) region->addr + region->page_cnt * PGSIZE;
+	size_t cnt;
+
+	if (start > end)
+		start = end;
+	if (page->advice == MADV_SEQUENTIAL)
+		cnt = RA_MAX_PAGES;
+	else if (page->va == region->ra_end && region->ra_pages > 0)
+		cnt = region->ra_pages * 2 < RA_MAX_PAGES
+			? region->ra_pages * 2 : RA_MAX_PAGES;
+	else if (page->va == region->addr || page->va == region->ra_end)
+		cnt = RA_MIN_PAGES;
+	else {
+		/* 순차가 아니면 readahead 하지 않고 다음 fault 위치만 기억해 둔다. */
+		region->ra_end = start;
+		region->ra_pages = 0;
+		return;
+	}
+
+	if ((size_t) (end - start) / PGSIZE < cnt)
+		cnt = (end - start) / PGSIZE;
+	region->ra_end = start;
+	region->ra_pages = cnt;
+	if (cnt == 0)
+		return;
+
+	inode_readahead (file_get_inode (region->file),
+			page->file.ofs + (start - (uint8_t *) page->va), cnt * PGSIZE);
+	ra_window_cnt++;
+	ra_page_cnt += cnt;
+}
+
+/* 미리 매핑된 페이지가 실제로 접근되었다면 fault 하나를 아낀 것으로 센다. */
+static void
+vm_check_prefault (struct page *page) {
+	if (page->prefaulted && (page->referenced
+				|| pml4_is_accessed (page->owner->pml4, page->va))) {
+		page->prefaulted = false;
+		fault_avoided_cnt++;
+	}
+}
+
+/* Backs the whole 2 MB aligned range around PAGE with one large page, if
+ * every page in it is an untouched, writable anonymous page and the user
+ * pool has a free, aligned 2 MB block.  All THP_PAGES pages count toward
+ * the RSS limit, so a process that would exceed it gets 4 kB pages.
+ * Otherwise, too, the caller falls back to 4 kB pages. */
+static bool
+vm_thp_fault (struct supplemental_page_table *spt, struct page *page) {
+	uint8_t *start = (uint8_t *) ((uint64_t) page->va & ~(LARGE_PGSIZE - 1));
+	struct thp *thp = NULL;
+	uint64_t *pt = NULL;
+	uint8_t *kva = NULL;
+	struct list frames;
+	struct list_elem *e;
+	size_t i;
+
+	list_init (&frames);
+	if (!is_user_vaddr (start + LARGE_PGSIZE - 1))
+		return false;
+	if (vm_rss_limit > 0
+			&& page->owner->vm_acct.rss + THP_PAGES > vm_rss_limit)
+		return false;
+	for (i = 0; i < THP_PAGES; i++) {
+		struct page *p = spt_find_page (spt, start + i * PGSIZE);
+		if (p == NULL || !vm_is_zero_fill (p) || !p->writable)
+			return false;
+	}
+
+	kva = palloc_get_aligned (PAL_USER, THP_PAGES);
+	if (kva == NULL) {
+		thp_fallback_cnt++;
+		return false;
+	}
+	thp = malloc (sizeof *thp);
+	pt = palloc_get_page (0);
+	if (thp == NULL || pt == NULL)
+		goto fail;
+
+	/* 프레임을 모두 만든 뒤에 매핑하고, 내용을 채운 다음에야 frame table 에
+	 * 넣어 clock 이 도중에 보지 못하게 한다. */
+	for (i = 0; i < THP_PAGES; i++) {
+		struct frame *frame = malloc (sizeof *frame);
+		if (frame == NULL)
+			goto fail;
+		vm_frame_init (frame, kva + i * PGSIZE);
+		frame->thp = thp;
+		list_push_back (&frames, &frame->frame_elem);
+	}
+	if (!pml4_set_large_page (page->owner->pml4, start, kva, true))
+		goto fail;
+
+	i = 0;
+	for (e = list_begin (&frames); e != list_end (&frames); e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, frame_elem);
+		struct page *p = spt_find_page (spt, start + i++ * PGSIZE);
+
+		p->frame = frame;
+		swap_in (p, frame->kva);
+		frame->page = p;
+	}
+	page->owner->vm_acct.rss += THP_PAGES;
+	thp->head = list_entry (list_front (&frames), struct frame, frame_elem);
+	thp->pt = pt;
+
+	lock_acquire (&frame_lock);
+	while (!list_empty (&frames))
+		list_push_back (&frame_table, list_pop_front (&frames));
+	lock_release (&frame_lock);
+	thp_alloc_cnt++;
+	return true;
+
+fail:
+	while (!list_empty (&frames))
+		free (list_entry (list_pop_front (&frames), struct frame, frame_elem));
+	palloc_free_page (pt);
+	free (thp);
+	palloc_free_multiple (kva, THP_PAGES);
+	return false;
+}
+
+/* Returns the last of the THP_PAGES frames of THP, which follow its head in
+ * the frame table.  The frame lock must be held. */
+static struct frame *
+vm_thp_tail (struct thp *thp) {
+	struct list_elem *e = &thp->head->frame_elem;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	for (size_t i = 1; i < THP_PAGES; i++)
+		e = list_next (e);
+	return list_entry (e, struct frame, frame_elem);
+}
+
+/* Breaks the 2 MB page that FRAME belongs to into 4 kB mappings, so that
+ * its pages can be evicted or freed one at a time.  The frame lock must be
+ * held. */
+static void
+vm_thp_split (struct frame *frame) {
+	struct thp *thp = frame->thp;
+	struct frame *f = thp->head;
+	struct page *head = f->page;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (head->owner->pml4 == NULL
+			|| !pml4_split_large_page (head->owner->pml4, head->va, thp->pt))
+		palloc_free_page (thp->pt);
+
+	for (size_t i = 0; i < THP_PAGES; i++) {
+		ASSERT (f->thp == thp);
+		f->thp = NULL;
+		if (i + 1 < THP_PAGES)
+			f = list_entry (list_next (&f->frame_elem), struct frame, frame_elem);
+	}
+	free (thp);
+	thp_split_cnt++;
+}
+
+/* Returns true if bringing in PAGE, which is not present, reads the disk. */
+static bool
+vm_fault_is_major (struct page *page) {
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			if (page->uninit.init == NULL)
+				return false;
+			return !vm_is_shared_text (page) || !text_is_cached (page);
+		case VM_ANON:
+			return page->anon.zswap == NULL;
+		default:
+			return true;
+	}
+}
+
+/* Brings in the non-present PAGE on a fault. */
+static bool
+vm_handle_fault (struct supplemental_page_table *spt, struct page *page,
+		bool write) {
+	struct mmap_region *region = file_page_region (page);
+
+	if (write && vm_is_zero_fill (page) && vm_thp_fault (spt, page))
+		return true;
+
+	/* 아직 한 번도 쓰이지 않은 익명 페이지를 읽기만 한다면
+	 * 프레임을 새로 할당하지 않고 zero frame 을 공유한다. */
+	if (!write && vm_is_zero_fill (page))
+		return vm_map_zero_page (page);
+
+	/* mmap 된 파일은 쓰기 fault 에서도 이웃을 미리 매핑하고, 그 뒤쪽은
+	 * readaheadd 에게 맡긴다. */
+	if (region != NULL || (!write && vm_is_lazy_file (page))) {
+		if (!vm_do_claim_page (page))
+			return false;
+		if (page->advice != MADV_RANDOM) {
+			uint8_t *end = vm_fault_around (spt, page);
+			if (region != NULL)
+				vm_readahead (page, region, end);
+		}
+		return true;
+	}
+
+	return vm_do_claim_page (page);
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_acct *acct = &thread_current ()->vm_acct;
 	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+	bool major, stack;
 
-	return vm_do_claim_page (page);
+	/* 커널 모드 fault 도 확인한다.  OOM killer 가 이미 프레임을 가져간
+	 * 페이지를 시스템 콜 도중에 건드리면 되살릴 내용이 없으므로, 패닉하는
+	 * 대신 여기서 프로세스를 끝낸다. */
+	vm_oom_check ();
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	stack = false;
+	page = spt_find_page (spt, addr);
+	if (page == NULL) {
+		if (!vm_is_stack_access (f, addr, user) || !vm_stack_growth (addr))
+			return false;
+		page = spt_find_page (spt, addr);
+		if (page == NULL)
+			return false;
+		stack = true;
+	}
+
+	/* 존재하는 페이지에 대한 쓰기 fault 는 write-protect fault 이다. */
+	if (!not_present) {
+		if (!write || !page->writable)
+			return false;
+		if (!vm_handle_wp (page)) {
+			vm_oom_check ();
+			return false;
+		}
+		acct->cow_faults++;
+		return true;
+	}
+
+	if (write && !page->writable)
+		return false;
+
+	/* 다른 스레드가 이 페이지를 evict 하는 중이면 매핑은 지워졌지만
+	 * page->frame 은 아직 남아 있다.  frame lock 을 거쳐 끝나기를 기다리고,
+	 * swap_out 이 실패해 매핑이 되살아났다면 그대로 다시 실행한다. */
+	if (page->frame != NULL) {
+		lock_acquire (&frame_lock);
+		lock_release (&frame_lock);
+		if (page->frame != NULL)
+			return pml4_get_page (thread_current ()->pml4, page->va) != NULL;
+	}
+
+	major = vm_fault_is_major (page);
+	if (!vm_handle_fault (spt, page, write)) {
+		vm_oom_check ();
+		return false;
+	}
+
+	if (stack)
+		acct->stack_faults++;
+	else if (major)
+		acct->major_faults++;
+	else
+		acct->minor_faults++;
+	return true;
+}
+
+/* Returns the working set size of the process with ACCT, in pages, as of
+ * the last wssd sample.  A process none of whose pages were touched in
+ * that sample has no entry for it.  The frame lock must be held. */
+static size_t
+vm_acct_wss (const struct vm_acct *acct) {
+	return acct->wss_gen == wss_gen ? acct->wss_cnt : 0;
+}
+
+/* Samples the accessed bits of every private frame once.  The whole pass
+ * runs under the frame lock, so readers never see a partial sample. */
+static void
+wss_sample (void) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	wss_gen++;
+	for (frame = vm_frame_next (NULL); frame != NULL;
+			frame = vm_frame_next (frame)) {
+		struct page *page = frame->page;
+		struct vm_acct *acct;
+		uint64_t *pml4;
+
+		if (page == NULL || (pml4 = page->owner->pml4) == NULL)
+			continue;
+
+		if (!pml4_is_accessed (pml4, page->va))
+			continue;
+		/* huge page 의 accessed bit 는 PDE 에 하나뿐이고 clock 이 지운다.
+		 * 여기서는 읽기만 한다. */
+		if (frame->thp == NULL) {
+			pml4_set_accessed (pml4, page->va, false);
+			page->referenced = true;
+		}
+
+		acct = &page->owner->vm_acct;
+		if (acct->wss_gen != wss_gen) {
+			acct->wss_gen = wss_gen;
+			acct->wss_cnt = 0;
+		}
+		acct->wss_cnt++;
+	}
+	lock_release (&frame_lock);
+}
+
+/* Working set estimator. */
+static void
+wssd (void *aux UNUSED) {
+	for (;;) {
+		timer_msleep (WSS_INTERVAL_MS);
+		wss_sample ();
+	}
+}
+
+/* Prints the paging counters of the current process, if "-vmstat" was
+ * given. */
+void
+vm_acct_print_exit (void) {
+	struct thread *t = thread_current ();
+	struct vm_acct *acct = &t->vm_acct;
+	size_t wss;
+
+	if (!vm_acct_print)
+		return;
+	lock_acquire (&frame_lock);
+	wss = vm_acct_wss (acct);
+	lock_release (&frame_lock);
+	printf ("%s: faults %lld minor, %lld major, %lld cow, %lld stack; "
+			"rss %zu pages, wss %zu pages\n", t->name,
+			acct->minor_faults, acct->major_faults, acct->cow_faults,
+			acct->stack_faults, acct->rss, wss);
+}
+
+/* Returns the paging counter COUNTER, one of the VMSTAT_* values, of the
+ * current process, or -1 if there is no such counter. */
+long long
+vm_acct_get (int counter) {
+	struct vm_acct *acct = &thread_current ()->vm_acct;
+
+	switch (counter) {
+		case VMSTAT_MINOR_FAULTS:
+			return acct->minor_faults;
+		case VMSTAT_MAJOR_FAULTS:
+			return acct->major_faults;
+		case VMSTAT_COW_FAULTS:
+			return acct->cow_faults;
+		case VMSTAT_STACK_FAULTS:
+			return acct->stack_faults;
+		case VMSTAT_RSS:
+			return acct->rss;
+		case VMSTAT_LOCKED:
+			return acct->locked;
+		case VMSTAT_SWAP:
+			return acct->swap;
+		default:
+			return -1;
+	}
+}
+
+/* Returns true if the LENGTH bytes at ADDR start on a page boundary, lie in
+ * user space and are covered entirely by pages in SPT. */
+static bool
+vm_range_is_mapped (struct supplemental_page_table *spt, void *addr,
+		size_t length) {
+	uintptr_t start = (uintptr_t) addr;
+
+	if (pg_ofs (addr) != 0 || length == 0 || start + length < start
+			|| !is_user_vaddr ((void *) (start + length - 1)))
+		return false;
+	for (uintptr_t va = start; va < start + length; va += PGSIZE)
+		if (spt_find_page (spt, (void *) va) == NULL)
+			return false;
+	return true;
+}
+
+/* Throws away the contents of the anonymous PAGE together with its frame
+ * and swap slot.  The next access sees a fresh zero-filled page. */
+static bool
+vm_discard_page (struct supplemental_page_table *spt, struct page *page) {
+	void *va = page->va;
+	int advice = page->advice;
+
+	/* 파일 페이지는 파일에 내용이 남아 있고, 아직 읽지 않은 페이지와
+	 * 읽기 전용 코드는 버릴 것이 없다. */
+	if (VM_TYPE (page->operations->type) != VM_ANON || !page->writable)
+		return true;
+	if (page->mlocked)
+		return false;
+
+	spt_remove_page (spt, page);
+	if (!vm_alloc_page (VM_ANON, va, true))
+		return false;
+	spt_find_page (spt, va)->advice = advice;
+	return true;
+}
+
+/* Applies madvise() ADVICE to the LENGTH bytes at ADDR in the current
+ * process.  Returns false if the range is not page aligned or not fully
+ * mapped, or if ADVICE is unknown. */
+bool
+vm_madvise (void *addr, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uintptr_t start = (uintptr_t) addr;
+
+	if (advice < MADV_NORMAL || advice > MADV_DONTNEED
+			|| !vm_range_is_mapped (spt, addr, length))
+		return false;
+
+	for (uintptr_t va = start; va < start + length; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, (void *) va);
+
+		switch (advice) {
+			case MADV_WILLNEED:
+				/* 아직 쓰이지 않은 익명 페이지는 읽어 올 내용이 없다. */
+				if (page->frame == NULL && !vm_is_zero_fill (page)
+						&& !vm_do_claim_page (page))
+					return false;
+				break;
+			case MADV_DONTNEED:
+				if (!vm_discard_page (spt, page))
+					return false;
+				break;
+			default:
+				page->advice = advice;
+				break;
+		}
+	}
+	return true;
+}
+
+/* Makes the mlocked PAGE resident in a frame of its own.  A writable page
+ * still on the zero frame or a merged frame gets a private copy now, so
+ * that a write to it later does not have to allocate. */
+static bool
+vm_mlock_page (struct page *page) {
+	struct frame *frame = page->frame;
+
+	if (frame != NULL && page->writable
+			&& (frame == &zero_frame || frame->merged)
+			&& !vm_handle_wp (page))
+		return false;
+	return page->frame != NULL || vm_do_claim_page (page);
+}
+
+/* Brings in the LENGTH bytes at ADDR and keeps them resident until
+ * vm_munlock().  Returns false on a bad range, if the process would lock
+ * more than MLOCK_MAX_PAGES pages, if all processes together would lock
+ * more than mlock_total_max, or if a page cannot be brought in; in every
+ * case nothing is left locked by this call. */
+bool
+vm_mlock (void *addr, size_t length) {
+	struct thread *t = thread_current ();
+	struct supplemental_page_table *spt = &t->spt;
+	uintptr_t start = (uintptr_t) addr;
+	struct page **marked;
+	size_t new_cnt = 0, i;
+	bool success = true;
+
+	if (!vm_range_is_mapped (spt, addr, length))
+		return false;
+	for (uintptr_t va = start; va < start + length; va += PGSIZE)
+		if (!spt_find_page (spt, (void *) va)->mlocked)
+			new_cnt++;
+	if (t->vm_acct.locked + new_cnt > MLOCK_MAX_PAGES)
+		return false;
+
+	/* 실패하면 이번에 새로 표시한 페이지만 되돌리도록 기억해 둔다. */
+	marked = new_cnt > 0 ? malloc (new_cnt * sizeof *marked) : NULL;
+	if (new_cnt > 0 && marked == NULL)
+		return false;
+
+	/* 전체 상한 검사와 표시를 frame lock 아래에서 한 번에 해서 다른
+	 * 프로세스와 함께 상한을 넘지 않게 한다.  clock 이 이미 고른 프레임도
+	 * 이렇게 빼앗지 않으며, 표시한 뒤에 읽어 온 프레임은 evict 되지 않는다. */
+	lock_acquire (&frame_lock);
+	if (mlock_total + new_cnt > mlock_total_max) {
+		lock_release (&frame_lock);
+		free (marked);
+		return false;
+	}
+	i = 0;
+	for (uintptr_t va = start; va < start + length; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, (void *) va);
+
+		if (!page->mlocked) {
+			page->mlocked = true;
+			t->vm_acct.locked++;
+			mlock_total++;
+			marked[i++] = page;
+		}
+	}
+	lock_release (&frame_lock);
+
+	for (uintptr_t va = start; va < start + length; va += PGSIZE)
+		if (!vm_mlock_page (spt_find_page (spt, (void *) va))) {
+			success = false;
+			break;
+		}
+	if (!success)
+		for (i = 0; i < new_cnt; i++)
+			vm_unlock_page (marked[i]);
+	free (marked);
+	return success;
+}
+
+/* Lets the LENGTH bytes at ADDR be evicted again. */
+bool
+vm_munlock (void *addr, size_t length) {
+	struct thread *t = thread_current ();
+	struct supplemental_page_table *spt = &t->spt;
+	uintptr_t start = (uintptr_t) addr;
+
+	if (!vm_range_is_mapped (spt, addr, length))
+		return false;
+	for (uintptr_t va = start; va < start + length; va += PGSIZE)
+		vm_unlock_page (spt_find_page (spt, (void *) va));
+	return true;
 }
 
 /* Free the page.
@@ -150,9 +1510,10 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
+	if (page == NULL)
+		return false;
 
 	return vm_do_claim_page (page);
 }
@@ -160,31 +1521,142 @@ vm_claim_page (void *va UNUSED) {
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
+	/* 읽기 전용 실행 코드는 가능하면 다른 프로세스와 프레임을 공유한다. */
+	if (vm_is_shared_text (page) && text_claim_page (page))
+		return true;
+
 	struct frame *frame = vm_get_frame ();
+	return frame != NULL && vm_claim_with_frame (page, frame);
+}
 
+/* Fills FRAME with the contents of PAGE and maps it. */
+static bool
+vm_claim_with_frame (struct page *page, struct frame *frame) {
 	/* Set links */
-	frame->page = page;
 	page->frame = frame;
+	page->owner->vm_acct.rss++;
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	/* 내용을 채우기 전까지는 frame->page 를 비워 두어 clock 이 건너뛰게 한다. */
+	if (!swap_in (page, frame->kva)
+			|| !pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable)) {
+		vm_free_frame (page);
+		return false;
+	}
+	frame->page = page;
+	return true;
+}
 
-	return swap_in (page, frame->kva);
+/* spt 해시 함수: 페이지의 va 로 해싱 */
+static uint64_t
+page_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page *page = hash_entry (e, struct page, spt_elem);
+	return hash_bytes (&page->va, sizeof page->va);
+}
+
+/* spt 비교 함수: va 순서 */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	const struct page *pa = hash_entry (a, struct page, spt_elem);
+	const struct page *pb = hash_entry (b, struct page, spt_elem);
+	return pa->va < pb->va;
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	hash_init (&spt->pages, page_hash, page_less, NULL);
+	list_init (&spt->mmaps);
+	spt->stack_bottom = (void *) USER_STACK;
 }
 
 /* Copy supplemental page table from src to dst */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+
+	dst->stack_bottom = src->stack_bottom;
+	hash_first (&i, &src->pages);
+	while (hash_next (&i)) {
+		struct page *src_page = hash_entry (hash_cur (&i), struct page, spt_elem);
+		struct page *dst_page;
+		struct frame *frame;
+
+		/* 내용이 전부 0 인 익명 페이지는 자식에서도 lazy 하게 둔다.
+		 * 첫 읽기 fault 에서 자식도 같은 zero frame 을 공유하게 된다. */
+		if (vm_is_zero_fill (src_page) || src_page->frame == &zero_frame) {
+			if (!vm_alloc_page (VM_ANON, src_page->va, src_page->writable))
+				return false;
+			continue;
+		}
+
+		/* 그 외의 페이지는 부모 쪽을 먼저 메모리에 올린다. */
+		if (src_page->frame == NULL && !vm_do_claim_page (src_page))
+			return false;
+
+		/* 공유 프레임 (text, ksmd 병합) 은 복사하지 않고 참조만 늘린다.
+		 * clock 이 공유 프레임을 내보낼 수 있으므로 frame lock 아래에서 본다. */
+		lock_acquire (&frame_lock);
+		if (src_page->frame != NULL && src_page->frame->share_cnt > 0) {
+			frame = src_page->frame;
+			bool ok = vm_alloc_page (VM_ANON, src_page->va, src_page->writable);
+			if (ok) {
+				vm_get_shared_frame (frame);
+				ok = vm_map_shared_frame (spt_find_page (dst, src_page->va),
+						frame);
+				if (!ok)
+					vm_put_shared_frame (frame);
+			}
+			lock_release (&frame_lock);
+			if (!ok)
+				return false;
+			continue;
+		}
+		lock_release (&frame_lock);
+
+		src_page->frame->pinned = true;
+
+		/* 파일 매핑은 자식에게 상속되지 않으므로 내용만 익명 페이지로 복사한다. */
+		enum vm_type type = page_get_type (src_page);
+		if (type == VM_FILE)
+			type = VM_ANON;
+		if (!vm_alloc_page (type, src_page->va, src_page->writable)) {
+			src_page->frame->pinned = false;
+			return false;
+		}
+
+		/* 자식의 프레임도 내용을 다 복사할 때까지 고정한다.  매핑된 직후
+		 * ksmd 가 아직 0 인 프레임을 병합해 해제하면 memcpy 가 해제된
+		 * 메모리에 쓰게 된다. */
+		dst_page = spt_find_page (dst, src_page->va);
+		frame = vm_get_frame ();
+		if (frame != NULL)
+			frame->pinned = true;
+		if (frame == NULL || !vm_claim_with_frame (dst_page, frame)) {
+			src_page->frame->pinned = false;
+			return false;
+		}
+		memcpy (frame->kva, src_page->frame->kva, PGSIZE);
+		frame->pinned = false;
+		src_page->frame->pinned = false;
+	}
+	return true;
+}
+
+/* spt 의 각 페이지를 해제하는 hash_action_func */
+static void
+page_destructor (struct hash_elem *e, void *aux UNUSED) {
+	struct page *page = hash_entry (e, struct page, spt_elem);
+	vm_unlock_page (page);
+	vm_dealloc_page (page);
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	/* 매핑된 파일의 dirty 페이지를 먼저 되돌려 쓰고 파일을 닫는다. */
+	do_munmap_all (spt);
+	hash_clear (&spt->pages, page_destructor);
 }
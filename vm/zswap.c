@@ -0,0 +1,345 @@
+/* zswap.c: Compressed in-memory tier in front of the swap disk.
+ *
+ * Evicted anonymous pages are first compressed into kernel memory.  Swapping
+ * them back in then costs a decompression instead of eight PIO sector reads.
+ * The tier holds at most ZSWAP_POOL_BYTES of malloc() blocks; when it is full
+ * the oldest entries are written back to the swap disk to make room.
+ *
+ * Pages are encoded as 8-byte words.  Every word gets a 2-bit tag: zero,
+ * same as the previous word, or a literal that follows the tag array.  A page
+ * whose words are all equal is stored as that single word. */
+
+#include <bitmap.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+#include "vm/zswap.h"
+
+/* 압축 데이터를 담을 최대 크기 (커널 풀에서 할당) */
+#define ZSWAP_POOL_BYTES (256 * PGSIZE)
+
+#define WORD_CNT (PGSIZE / sizeof (uint64_t))
+#define TAG_BYTES (WORD_CNT / 4)
+
+/* malloc 의 가장 큰 블록. 이보다 크면 페이지를 통째로 할당하므로
+ * 헤더까지 이 안에 들어가는 페이지만 압축해 둔다. */
+#define ZSWAP_MAX_BLOCK 1024
+#define ZSWAP_MAX_SIZE (ZSWAP_MAX_BLOCK - sizeof (struct zswap_entry))
+
+/* word 태그 */
+enum {
+	TAG_ZERO = 0,       /* 0 인 word */
+	TAG_REPEAT = 1,     /* 바로 앞 word 와 같음 */
+	TAG_LITERAL = 2,    /* 뒤따르는 literal 영역에서 읽음 */
+};
+
+/* 압축된 페이지 하나 */
+struct zswap_entry {
+	struct list_elem elem;      /* zswap_lru 의 원소 (앞쪽이 오래된 항목) */
+	struct page *page;          /* 이 내용을 가진 익명 페이지 */
+	bool detached;              /* 디스크로 쓰는 중이라 LRU 에서 빠짐 */
+	bool same_filled;           /* 모든 word 가 같은 값인 페이지 */
+	size_t size;                /* data 의 바이트 수 */
+	uint8_t data[];             /* 압축된 내용 */
+};
+
+static struct list zswap_lru;
+static struct lock zswap_lock;
+static size_t zswap_bytes;      /* 현재 tier 의 항목이 차지한 malloc 바이트 수 */
+
+/* 통계 */
+static long long store_cnt;         /* tier 에 저장한 페이지 수 */
+static long long same_filled_cnt;   /* 그 중 같은 값으로 채워진 페이지 수 */
+static long long reject_cnt;        /* 압축이 잘 안 되어 바로 디스크로 간 수 */
+static long long writeback_cnt;     /* 공간이 부족해 디스크로 내려보낸 수 */
+static long long load_hit_cnt;      /* swap in 을 tier 에서 처리한 수 */
+static long long load_miss_cnt;     /* swap in 을 디스크에서 처리한 수 */
+static long long stored_bytes;      /* 저장한 원본 바이트 합 */
+static long long compressed_bytes;  /* 저장한 항목의 malloc 블록 크기 합 */
+
+static inline void
+set_tag (uint8_t *tags, size_t i, int tag) {
+	tags[i / 4] |= tag << (i % 4 * 2);
+}
+
+static inline int
+get_tag (const uint8_t *tags, size_t i) {
+	return (tags[i / 4] >> (i % 4 * 2)) & 3;
+}
+
+/* Returns the bytes that malloc() reserves for an entry with SIZE bytes of
+ * data: the smallest power of two, at least 16, that holds it. */
+static size_t
+entry_footprint (size_t size) {
+	size_t block = 16;
+
+	while (block < sizeof (struct zswap_entry) + size)
+		block *= 2;
+	return block;
+}
+
+/* Compresses the page at KVA into BUF, which must hold PGSIZE bytes.
+ * Returns the compressed size, or 0 if it would exceed ZSWAP_MAX_SIZE. */
+static size_t
+compress_page (const void *kva, uint8_t *buf) {
+	const uint64_t *words = kva;
+	uint8_t *tags = buf;
+	uint8_t *out = buf + TAG_BYTES;
+	uint64_t prev = 0;
+
+	memset (tags, 0, TAG_BYTES);
+	for (size_t i = 0; i < WORD_CNT; i++) {
+		uint64_t w = words[i];
+		if (w == 0)
+			set_tag (tags, i, TAG_ZERO);
+		else if (w == prev)
+			set_tag (tags, i, TAG_REPEAT);
+		else {
+			if ((size_t) (out - buf) + sizeof w > ZSWAP_MAX_SIZE)
+				return 0;
+			set_tag (tags, i, TAG_LITERAL);
+			memcpy (out, &w, sizeof w);
+			out += sizeof w;
+		}
+		prev = w;
+	}
+	return out - buf;
+}
+
+/* Expands the compressed data in BUF into the page at KVA. */
+static void
+decompress_page (const uint8_t *buf, void *kva) {
+	uint64_t *words = kva;
+	const uint8_t *tags = buf;
+	const uint8_t *in = buf + TAG_BYTES;
+	uint64_t prev = 0;
+
+	for (size_t i = 0; i < WORD_CNT; i++) {
+		switch (get_tag (tags, i)) {
+			case TAG_ZERO:
+				words[i] = 0;
+				break;
+			case TAG_REPEAT:
+				words[i] = prev;
+				break;
+			default:
+				memcpy (&words[i], in, sizeof words[i]);
+				in += sizeof words[i];
+				break;
+		}
+		prev = words[i];
+	}
+}
+
+/* Returns true if every word of the page at KVA equals the first one. */
+static bool
+page_same_filled (const void *kva) {
+	const uint64_t *words = kva;
+	for (size_t i = 1; i < WORD_CNT; i++)
+		if (words[i] != words[0])
+			return false;
+	return true;
+}
+
+/* Restores the contents of ENTRY into the page at KVA. */
+static void
+zswap_expand (const struct zswap_entry *entry, void *kva) {
+	if (entry->same_filled) {
+		uint64_t *words = kva, fill;
+		memcpy (&fill, entry->data, sizeof fill);
+		for (size_t i = 0; i < WORD_CNT; i++)
+			words[i] = fill;
+	} else
+		decompress_page (entry->data, kva);
+}
+
+/* Unlinks ENTRY from the tier and frees it. */
+static void
+zswap_free (struct zswap_entry *entry) {
+	ASSERT (lock_held_by_current_thread (&zswap_lock));
+	list_remove (&entry->elem);
+	zswap_bytes -= entry_footprint (entry->size);
+	entry->page->anon.zswap = NULL;
+	free (entry);
+}
+
+/* Detaches ENTRY from its page.  An entry that zswap_make_room() is writing
+ * back is left for it to free. */
+static void
+zswap_drop (struct zswap_entry *entry) {
+	ASSERT (lock_held_by_current_thread (&zswap_lock));
+	if (entry->detached) {
+		entry->page->anon.zswap = NULL;
+		entry->page = NULL;
+	} else
+		zswap_free (entry);
+}
+
+/* Writes the oldest entries back to the swap disk until NEED more bytes
+ * fit in the tier.  Each entry is taken off the LRU under zswap_lock, but
+ * zswap_lock is released around the disk write; if the page is loaded or
+ * destroyed meanwhile, its new slot is given back.  Returns false if the
+ * swap disk is full. */
+static bool
+zswap_make_room (size_t need) {
+	void *bounce = NULL;
+	bool success = true;
+
+	ASSERT (lock_held_by_current_thread (&zswap_lock));
+	while (zswap_bytes + need > ZSWAP_POOL_BYTES && !list_empty (&zswap_lru)) {
+		struct zswap_entry *entry;
+		size_t slot;
+
+		if (bounce == NULL) {
+			bounce = palloc_get_page (0);
+			if (bounce == NULL) {
+				success = false;
+				break;
+			}
+		}
+		entry = list_entry (list_pop_front (&zswap_lru),
+				struct zswap_entry, elem);
+		entry->detached = true;
+		zswap_bytes -= entry_footprint (entry->size);
+		zswap_expand (entry, bounce);
+
+		lock_release (&zswap_lock);
+		slot = anon_write_slot (bounce, 1);
+		lock_acquire (&zswap_lock);
+
+		if (entry->page == NULL) {
+			/* 쓰는 동안 페이지가 다시 읽혔거나 해제되었다. */
+			if (slot != BITMAP_ERROR)
+				anon_release_slot (slot);
+			free (entry);
+			continue;
+		}
+		if (slot == BITMAP_ERROR) {
+			/* swap disk 가 가득 찼으므로 항목을 tier 에 되돌린다. */
+			entry->detached = false;
+			list_push_front (&zswap_lru, &entry->elem);
+			zswap_bytes += entry_footprint (entry->size);
+			success = false;
+			break;
+		}
+		entry->page->anon.swap_slot = slot;
+		entry->page->owner->vm_acct.swap++;
+		entry->page->anon.zswap = NULL;
+		free (entry);
+		writeback_cnt++;
+	}
+	palloc_free_page (bounce);
+	return success;
+}
+
+/* Initializes the compressed swap tier. */
+void
+zswap_init (void) {
+	list_init (&zswap_lru);
+	lock_init (&zswap_lock);
+	zswap_bytes = 0;
+}
+
+/* Tries to keep the contents of PAGE, currently at KVA, in the compressed
+ * tier.  Returns false if the page does not compress well or there is no
+ * room, in which case the caller writes it to the swap disk. */
+bool
+zswap_store (struct page *page, const void *kva) {
+	struct zswap_entry *entry;
+	uint8_t *buf = NULL;
+	size_t size;
+	bool same;
+
+	same = page_same_filled (kva);
+	if (same)
+		size = sizeof (uint64_t);
+	else {
+		buf = palloc_get_page (0);
+		if (buf == NULL)
+			return false;
+		size = compress_page (kva, buf);
+		if (size == 0) {
+			palloc_free_page (buf);
+			reject_cnt++;
+			return false;
+		}
+	}
+
+	entry = malloc (sizeof *entry + size);
+	if (entry == NULL) {
+		palloc_free_page (buf);
+		return false;
+	}
+	entry->page = page;
+	entry->detached = false;
+	entry->same_filled = same;
+	entry->size = size;
+	memcpy (entry->data, same ? kva : buf, size);
+	palloc_free_page (buf);
+
+	lock_acquire (&zswap_lock);
+	if (!zswap_make_room (entry_footprint (size))) {
+		lock_release (&zswap_lock);
+		free (entry);
+		return false;
+	}
+	list_push_back (&zswap_lru, &entry->elem);
+	zswap_bytes += entry_footprint (size);
+	page->anon.zswap = entry;
+
+	store_cnt++;
+	if (same)
+		same_filled_cnt++;
+	stored_bytes += PGSIZE;
+	compressed_bytes += entry_footprint (size);
+	lock_release (&zswap_lock);
+	return true;
+}
+
+/* Restores PAGE into KVA if its contents are in the compressed tier.
+ * Returns false if the page must be read from the swap disk. */
+bool
+zswap_load (struct page *page, void *kva) {
+	struct zswap_entry *entry;
+
+	lock_acquire (&zswap_lock);
+	entry = page->anon.zswap;
+	if (entry == NULL) {
+		load_miss_cnt++;
+		lock_release (&zswap_lock);
+		return false;
+	}
+	zswap_expand (entry, kva);
+	zswap_drop (entry);
+	load_hit_cnt++;
+	lock_release (&zswap_lock);
+	return true;
+}
+
+/* Drops PAGE's compressed contents, if any, when the page is destroyed. */
+void
+zswap_invalidate (struct page *page) {
+	lock_acquire (&zswap_lock);
+	if (page->anon.zswap != NULL)
+		zswap_drop (page->anon.zswap);
+	lock_release (&zswap_lock);
+}
+
+/* Prints compressed swap statistics. */
+void
+zswap_print_stats (void) {
+	long long loads = load_hit_cnt + load_miss_cnt;
+
+	printf ("Zswap: %lld pages stored (%lld same-filled), %lld rejected, "
+			"%lld written back\n",
+			store_cnt, same_filled_cnt, reject_cnt, writeback_cnt);
+	printf ("Zswap: compressed to %lld%% of original, hit rate %lld%% "
+			"(%lld of %lld swap-ins)\n",
+			stored_bytes ? compressed_bytes * 100 / stored_bytes : 0,
+			loads ? load_hit_cnt * 100 / loads : 0, load_hit_cnt, loads);
+}